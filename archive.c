@@ -0,0 +1,1959 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "lz78.h"
+#include "lz77.h"
+#include "pool.h"
+#include "filter.h"
+
+/* Layout of the container:
+   header | compressed blocks | index | trailer
+   The index lists the files (in the order of their logical offset in the
+   concatenation of all the files) followed by the blocks. Each block covers
+   a range of the concatenation: normally blocks never span two files, in
+   solid mode they are cut regardless of the boundaries of the files so that
+   small files share the dictionary. Blocks are independent, so they are the
+   checkpoints from which a single file is extracted. When priming is
+   enabled the dictionary of a lz78 block is primed with the tail of the
+   previous block of its chain, so the checkpoints are the chains. Long
+   holes of sparse files are zero blocks, which have no payload. In record
+   mode blocks are cut at line boundaries and the block entries are followed
+   by the number of records (lines) ending in each block. Last come the
+   checksums (CRC-32) of the uncompressed data of the blocks. */
+#define ARCHIVE_MAGIC         "LZ7A"
+#define ARCHIVE_VERSION       1
+#define HEADER_SIZE           32
+#define TRAILER_SIZE          20
+#define FILE_ENTRY_SIZE       24
+#define BLOCK_ENTRY_SIZE      20
+#define PATH_MAX_LEN          65535
+
+/* Flags of the header */
+#define ARCHIVE_FLAG_SOLID    1
+#define ARCHIVE_FLAG_FILTER   2
+#define ARCHIVE_FLAG_WIDE     4
+#define ARCHIVE_FLAG_RECORDS  8
+#define ARCHIVE_FLAG_CHECKSUM 16
+
+/* Size of an entry of the numbers of records of the blocks */
+#define RECORD_ENTRY_SIZE     4
+/* Size of the buffer used to find the records of the files */
+#define RECORD_BUFFER_SIZE    1048576
+
+/* Size of an entry of the checksums of the blocks */
+#define CHECKSUM_ENTRY_SIZE   4
+/* Polynomial of the CRC-32 (reversed) */
+#define CRC_POLY              0xEDB88320
+
+/* Offset of the chain of filters into the header (kind and stride of each
+   filter, a kind of FILTER_NONE ends the chain) */
+#define HEADER_FILTERS        24
+
+/* Blocks are sampled in SAMPLE_COUNT chunks of SAMPLE_SIZE bytes to estimate
+   their entropy: above ENTROPY_STORED bits per byte they are stored */
+#define SAMPLE_COUNT          16
+#define SAMPLE_SIZE           4096
+#define ENTROPY_STORED        7.5
+
+/* Ways of moving stored blocks between descriptors */
+#define COPY_RANGE            0
+#define COPY_SPLICE           1
+#define COPY_BUFFER           2
+/* Size of the buffer used when data cannot move inside the kernel */
+#define COPY_BUFFER_SIZE      1048576
+
+/* Number of blocks of a priming chain: the first block of a chain is not
+   primed, so chains are decoded in parallel */
+#define ARCHIVE_PRIME_CHAIN   8
+
+/* Holes of the files of at least HOLE_MIN bytes are recorded as zero blocks
+   of at most ZERO_BLOCK_MAX bytes, which have no payload; on extraction the
+   pages of HOLE_PAGE bytes which are all zeros are not written */
+#define HOLE_MIN              ARCHIVE_BLOCK_MIN
+#define HOLE_PAGE             4096
+#define ZERO_BLOCK_MAX        1073741824
+
+/* Limit the block size into the allowed range */
+#define BLOCK_LIMIT(x) (((x) < ARCHIVE_BLOCK_MIN) ? ARCHIVE_BLOCK_MIN : \
+                        ((x) > ARCHIVE_BLOCK_MAX) ? ARCHIVE_BLOCK_MAX : (x))
+
+/* Entry of a file */
+struct __archive_file {
+    char* source;             /* Path of the file on the filesystem */
+    char* path;               /* Path stored into the archive */
+    uint32_t mode;            /* Permission bits */
+    uint64_t size;            /* Size of the file */
+    uint64_t offset;          /* Offset into the concatenation of the files */
+    uint8_t selected;         /* Flag indicating the file is extracted */
+};
+
+/* The opaque type of the entry of a file */
+typedef struct __archive_file archive_file;
+
+/* Entry of a block */
+struct __archive_block {
+    uint64_t start;           /* Offset into the concatenation of the files */
+    uint64_t offset;          /* Offset of the payload into the archive */
+    uint32_t raw_len;         /* Size of the uncompressed data */
+    uint32_t comp_len;        /* Size of the payload */
+    uint8_t type;             /* Algorithm used to compress the block */
+    uint8_t needed;           /* Flag indicating the block is extracted */
+    uint32_t records;         /* Number of records ending in the block */
+    uint32_t crc;             /* Checksum of the uncompressed data */
+    char* data;               /* Payload waiting to be written */
+};
+
+/* The opaque type of the entry of a block */
+typedef struct __archive_block archive_block;
+
+/* State owned by a worker of the pool: codec and buffers are allocated by
+   the worker itself, so that they are placed on its NUMA node */
+struct __archive_worker {
+    void* codec;              /* Instance of the algorithm (lazily created) */
+    int fd;                   /* Currently opened file */
+    uint32_t fd_file;         /* Index of the currently opened file */
+    char* buf;                /* Uncompressed data */
+    uint32_t buf_size;        /* Size of buf */
+    char* cbuf;               /* Compressed data */
+    uint32_t cbuf_size;       /* Size of cbuf */
+    char* pbuf;               /* Tail of the previously decoded block */
+};
+
+/* The opaque type of the state of a worker */
+typedef struct __archive_worker archive_worker;
+
+/* Struct of archive */
+struct __archive {
+    uint8_t mode;             /* Flag indicating create/extract mode */
+    uint8_t type;             /* Type of the blocks */
+    uint16_t flags;           /* Flags of the header */
+    uint32_t param;           /* Parameter of the algorithm */
+    uint32_t n_threads;       /* Number of workers */
+    uint8_t pool_flags;       /* Flags of the pool of workers */
+    uint32_t b_size;          /* Size of the blocks */
+    uint32_t prime;           /* Size of the tail priming the next block */
+    uint32_t chain;           /* Number of blocks of a priming chain */
+    uint32_t batch;           /* Records per block (0 not record-oriented) */
+    filter filters[FILTER_CHAIN_MAX]; /* Filters of the compressed blocks */
+    uint8_t n_filters;        /* Number of filters */
+    uint64_t total;           /* Size of the concatenation of the files */
+    archive_file* files;      /* Entries of the files */
+    uint32_t n_files;         /* Number of files */
+    uint32_t files_size;      /* Allocated entries of files */
+    archive_block* blocks;    /* Entries of the blocks */
+    uint32_t n_blocks;        /* Number of blocks */
+    char** members;           /* Members selected for the extraction */
+    uint32_t n_members;       /* Number of selected members */
+    archive_worker* workers;  /* State of the workers */
+    int fd;                   /* Archive being extracted */
+    const char* dest;         /* Destination directory of the extraction */
+    uint8_t test;             /* Flag replacing extraction with its test */
+};
+
+/* Tables of the CRC-32 computed 8 bytes at a time */
+static uint32_t crc_table[8][256];
+
+/* Little-endian helpers for the on-disk structures */
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static void put64(uint8_t* p, uint64_t v) {
+    put32(p, v);
+    put32(p + 4, v >> 32);
+}
+
+static uint16_t get16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return get16(p) | ((uint32_t) get16(p + 2) << 16);
+}
+
+static uint64_t get64(const uint8_t* p) {
+    return get32(p) | ((uint64_t) get32(p + 4) << 32);
+}
+
+/* Fill the tables of the CRC-32 (once) */
+static void crc_init(void) {
+    uint32_t c;
+    int i, j;
+
+    if (crc_table[0][1] != 0)
+        return;
+    for (i = 0; i < 256; ++i) {
+        c = i;
+        for (j = 0; j < 8; ++j)
+            c = (c & 1) ? (c >> 1) ^ CRC_POLY : c >> 1;
+        crc_table[0][i] = c;
+    }
+    for (i = 0; i < 256; ++i)
+        for (j = 1; j < 8; ++j)
+            crc_table[j][i] = (crc_table[j - 1][i] >> 8) ^
+                              crc_table[0][crc_table[j - 1][i] & 0xFF];
+}
+
+/* Return the CRC-32 of a buffer */
+static uint32_t crc32(const char* buf, size_t n) {
+    const uint8_t* p = (const uint8_t*) buf;
+    uint32_t c = 0xFFFFFFFF;
+
+    while (n >= 8) {
+        c ^= get32(p);
+        c = crc_table[7][c & 0xFF] ^ crc_table[6][(c >> 8) & 0xFF] ^
+            crc_table[5][(c >> 16) & 0xFF] ^ crc_table[4][c >> 24] ^
+            crc_table[3][p[4]] ^ crc_table[2][p[5]] ^
+            crc_table[1][p[6]] ^ crc_table[0][p[7]];
+        p += 8;
+        n -= 8;
+    }
+    while (n-- > 0)
+        c = (c >> 8) ^ crc_table[0][(c ^ *p++) & 0xFF];
+    return ~c;
+}
+
+/* Write all the buffer, waiting on a non-blocking descriptor
+   Return:  0 on success, -1 on failure
+ */
+static int write_all(int fd, const char* buf, size_t n) {
+    struct pollfd pfd;
+    ssize_t w;
+
+    while (n > 0) {
+        w = write(fd, buf, n);
+        if (w < 0 && errno == EAGAIN) {
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return -1;
+        buf += w;
+        n -= w;
+    }
+    return 0;
+}
+
+/* Read exactly n bytes at the given offset
+   Return:  0 on success, -1 on failure or short file
+ */
+static int pread_all(int fd, char* buf, size_t n, uint64_t off) {
+    ssize_t r;
+
+    while (n > 0) {
+        r = pread(fd, buf, n, off);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        buf += r;
+        n -= r;
+        off += r;
+    }
+    return 0;
+}
+
+/* Write exactly n bytes at the given offset
+   Return:  0 on success, -1 on failure
+ */
+static int pwrite_all(int fd, const char* buf, size_t n, uint64_t off) {
+    ssize_t w;
+
+    while (n > 0) {
+        w = pwrite(fd, buf, n, off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return -1;
+        buf += w;
+        n -= w;
+        off += w;
+    }
+    return 0;
+}
+
+/* Check whether a buffer is all zeros
+   Return:  1 if it is, 0 otherwise
+ */
+static int is_zero(const char* buf, size_t n) {
+    return n == 0 || (buf[0] == 0 && memcmp(buf, buf + 1, n - 1) == 0);
+}
+
+/* Write a buffer into a region of a file which is still a hole, skipping the
+   aligned pages which are all zeros so that they stay holes
+   Return:  0 on success, -1 on failure
+ */
+static int pwrite_sparse(int fd, const char* buf, size_t n, uint64_t off) {
+    size_t data = 0;
+    size_t i = 0;
+    size_t len;
+
+    while (i < n) {
+        len = HOLE_PAGE - (off + i) % HOLE_PAGE;
+        len = (len < n - i) ? len : n - i;
+        if (len == HOLE_PAGE && is_zero(buf + i, len)) {
+            if (i > data && pwrite_all(fd, buf + data, i - data,
+                                       off + data) == -1)
+                return -1;
+            data = i + len;
+        }
+        i += len;
+    }
+    return (n > data) ? pwrite_all(fd, buf + data, n - data, off + data) : 0;
+}
+
+/* Grow a buffer to at least n bytes
+   Return:  0 on success, -1 on failure
+ */
+static int buffer_reserve(char** buf, uint32_t* size, uint32_t n) {
+    char* p;
+
+    if (*size >= n)
+        return 0;
+    p = realloc(*buf, n);
+    if (p == NULL)
+        return -1;
+    *buf = p;
+    *size = n;
+    return 0;
+}
+
+/* Copy n bytes from fd_in at off_in to fd_out, at *off_out or at its current
+   position when off_out is NULL. Data moves inside the kernel when possible
+   (copy_file_range between files, splice towards pipes), through the given
+   buffer otherwise
+   Return:  0 on success, -1 on failure
+ */
+static int copy_fd(int fd_in, uint64_t off_in, int fd_out, uint64_t* off_out,
+                   uint64_t n, char** buf, uint32_t* size) {
+    struct pollfd pfd;
+    loff_t in = off_in;
+    loff_t out = (off_out != NULL) ? *off_out : 0;
+    ssize_t r;
+    size_t len;
+    int how = COPY_RANGE;
+
+    while (n > 0) {
+        len = (n > COPY_BUFFER_SIZE) ? COPY_BUFFER_SIZE : n;
+        if (how == COPY_RANGE) {
+            r = copy_file_range(fd_in, &in, fd_out,
+                                (off_out != NULL) ? &out : NULL, len, 0);
+        } else if (how == COPY_SPLICE) {
+            r = splice(fd_in, &in, fd_out, NULL, len, SPLICE_F_MOVE);
+        } else {
+            if (buffer_reserve(buf, size, COPY_BUFFER_SIZE) == -1 ||
+                    pread_all(fd_in, *buf, len, in) == -1)
+                return -1;
+            if (off_out != NULL)
+                r = pwrite_all(fd_out, *buf, len, out);
+            else
+                r = write_all(fd_out, *buf, len);
+            if (r == -1)
+                return -1;
+            in += len;
+            out += len;
+            r = len;
+        }
+
+        if (r < 0 && errno == EAGAIN) {
+            pfd.fd = fd_out;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if (r < 0 && errno == EINTR)
+            continue;
+        /* Not supported by the descriptors: fall back to the next way */
+        if (r < 0 && (errno == EINVAL || errno == EXDEV || errno == ENOSYS ||
+                      errno == EOPNOTSUPP || errno == EBADF ||
+                      errno == ESPIPE)) {
+            how = (how == COPY_RANGE && off_out == NULL) ? COPY_SPLICE :
+                  COPY_BUFFER;
+            continue;
+        }
+        if (r <= 0)
+            return -1;
+        n -= r;
+    }
+
+    if (off_out != NULL)
+        *off_out = out;
+    return 0;
+}
+
+/* Return the path as stored into the archive (without leading "/", "./"
+   and "../")
+ */
+static const char* archive_strip(const char* path) {
+    for (;;) {
+        if (path[0] == '/')
+            ++path;
+        else if (path[0] == '.' && path[1] == '/')
+            path += 2;
+        else if (path[0] == '.' && path[1] == '.' && path[2] == '/')
+            path += 3;
+        else
+            return path;
+    }
+}
+
+/* Check that a stored path does not escape the destination directory
+   Return:  0 if the path is safe, -1 otherwise
+ */
+static int archive_check_path(const char* path) {
+    const char* p = path;
+    size_t n;
+
+    if (path[0] == '\0' || path[0] == '/')
+        return -1;
+
+    while (*p) {
+        n = strcspn(p, "/");
+        if (n == 2 && p[0] == '.' && p[1] == '.')
+            return -1;
+        p += n;
+        if (*p == '/')
+            ++p;
+    }
+    return 0;
+}
+
+/* Append the entry of a regular file */
+static uint8_t archive_push(archive* a, const char* source, struct stat* st) {
+    archive_file* f;
+    const char* path = archive_strip(source);
+
+    if (archive_check_path(path) == -1 || strlen(path) > PATH_MAX_LEN)
+        return ARCHIVE_ERROR_PATH;
+
+    if (a->n_files == a->files_size) {
+        f = realloc(a->files, (a->files_size * 2 + 16) * sizeof(archive_file));
+        if (f == NULL)
+            return ARCHIVE_ERROR_MEMORY;
+        a->files = f;
+        a->files_size = a->files_size * 2 + 16;
+    }
+
+    f = &a->files[a->n_files];
+    f->source = strdup(source);
+    if (f->source == NULL)
+        return ARCHIVE_ERROR_MEMORY;
+    f->path = f->source + (path - source);
+    f->mode = st->st_mode & 07777;
+    f->size = st->st_size;
+    f->offset = 0;
+    ++(a->n_files);
+    return ARCHIVE_SUCCESS;
+}
+
+/* Sort the entries of a directory by name so that the archive does not
+   depend on the order of the filesystem */
+static int archive_name_cmp(const struct dirent** x, const struct dirent** y) {
+    return strcmp((*x)->d_name, (*y)->d_name);
+}
+
+/* Recursively add a path (symbolic links and special files are skipped) */
+static uint8_t archive_walk(archive* a, const char* path) {
+    struct dirent** list;
+    struct stat st;
+    char* child;
+    uint8_t ret = ARCHIVE_SUCCESS;
+    int n, i;
+
+    if (lstat(path, &st) == -1)
+        return ARCHIVE_ERROR_READ;
+
+    if (S_ISREG(st.st_mode))
+        return archive_push(a, path, &st);
+
+    if (!S_ISDIR(st.st_mode))
+        return ARCHIVE_SUCCESS;
+
+    n = scandir(path, &list, NULL, archive_name_cmp);
+    if (n < 0)
+        return ARCHIVE_ERROR_READ;
+
+    for (i = 0; i < n; ++i) {
+        if (ret == ARCHIVE_SUCCESS && strcmp(list[i]->d_name, ".") != 0 &&
+                strcmp(list[i]->d_name, "..") != 0) {
+            if (asprintf(&child, "%s%s%s", path,
+                         path[strlen(path) - 1] == '/' ? "" : "/",
+                         list[i]->d_name) == -1) {
+                ret = ARCHIVE_ERROR_MEMORY;
+            } else {
+                ret = archive_walk(a, child);
+                free(child);
+            }
+        }
+        free(list[i]);
+    }
+    free(list);
+    return ret;
+}
+
+archive* archive_new(uint8_t mode, uint8_t type, uint32_t param) {
+    archive* a;
+
+    if (mode != ARCHIVE_MODE_CREATE && mode != ARCHIVE_MODE_EXTRACT)
+        return NULL;
+
+    if (type != ARCHIVE_BLOCK_LZ78 && type != ARCHIVE_BLOCK_LZ77)
+        return NULL;
+
+    a = calloc(1, sizeof(archive));
+    if (a == NULL)
+        return NULL;
+
+    a->mode = mode;
+    a->type = type;
+    a->param = param;
+    a->n_threads = pool_cpus();
+    a->b_size = ARCHIVE_BLOCK_DEFAULT;
+    a->chain = 1;
+    a->fd = -1;
+    if (mode == ARCHIVE_MODE_CREATE)
+        a->flags = ARCHIVE_FLAG_CHECKSUM;
+    crc_init();
+    return a;
+}
+
+uint8_t archive_set(archive* a, uint8_t option, uint32_t value) {
+    switch (option) {
+        case ARCHIVE_OPTION_THREADS:
+            a->n_threads = (value == 0) ? pool_cpus() : value;
+            break;
+
+        case ARCHIVE_OPTION_BLOCK_SIZE:
+            a->b_size = BLOCK_LIMIT(value);
+            break;
+
+        case ARCHIVE_OPTION_SOLID:
+            if (value)
+                a->flags |= ARCHIVE_FLAG_SOLID;
+            else
+                a->flags &= ~ARCHIVE_FLAG_SOLID;
+            break;
+
+        case ARCHIVE_OPTION_NUMA:
+            a->pool_flags = value ? POOL_NUMA : 0;
+            break;
+
+        case ARCHIVE_OPTION_PRIME:
+            a->prime = (value > ARCHIVE_PRIME_MAX) ? ARCHIVE_PRIME_MAX : value;
+            break;
+
+        case ARCHIVE_OPTION_RECORDS:
+            a->batch = value;
+            if (value)
+                a->flags |= ARCHIVE_FLAG_RECORDS;
+            else
+                a->flags &= ~ARCHIVE_FLAG_RECORDS;
+            break;
+
+        case ARCHIVE_OPTION_CHECKSUM:
+            if (value)
+                a->flags |= ARCHIVE_FLAG_CHECKSUM;
+            else
+                a->flags &= ~ARCHIVE_FLAG_CHECKSUM;
+            break;
+
+        case ARCHIVE_OPTION_ALPHABET:
+            if (value == LZ78_ALPHABET_WIDE)
+                a->flags |= ARCHIVE_FLAG_WIDE;
+            else if (value == LZ78_ALPHABET_BYTE)
+                a->flags &= ~ARCHIVE_FLAG_WIDE;
+            else
+                return ARCHIVE_ERROR_OPTION;
+            break;
+
+        case ARCHIVE_OPTION_FILTER:
+            if (value == 0) {
+                a->n_filters = 0;
+                break;
+            }
+            if (a->n_filters == FILTER_CHAIN_MAX)
+                return ARCHIVE_ERROR_OPTION;
+            a->filters[a->n_filters].kind = value >> 8;
+            a->filters[a->n_filters].stride = value & 0xFF;
+            if (value > 0xFFFF ||
+                    filter_check(&a->filters[a->n_filters]) == -1)
+                return ARCHIVE_ERROR_OPTION;
+            ++a->n_filters;
+            break;
+
+        default:
+            return ARCHIVE_ERROR_OPTION;
+    }
+    return ARCHIVE_SUCCESS;
+}
+
+uint8_t archive_add(archive* a, const char* path) {
+    char** m;
+    char* member;
+    size_t n;
+
+    if (a->mode == ARCHIVE_MODE_CREATE)
+        return archive_walk(a, path);
+
+    member = strdup(archive_strip(path));
+    if (member == NULL)
+        return ARCHIVE_ERROR_MEMORY;
+    n = strlen(member);
+    while (n > 0 && member[n - 1] == '/')
+        member[--n] = '\0';
+
+    m = realloc(a->members, (a->n_members + 1) * sizeof(char*));
+    if (m == NULL) {
+        free(member);
+        return ARCHIVE_ERROR_MEMORY;
+    }
+    a->members = m;
+    a->members[a->n_members++] = member;
+    return ARCHIVE_SUCCESS;
+}
+
+uint8_t archive_add_list(archive* a, const char* list) {
+    FILE* f;
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t n;
+    uint8_t ret = ARCHIVE_SUCCESS;
+
+    f = (strcmp(list, "-") == 0) ? stdin : fopen(list, "r");
+    if (f == NULL)
+        return ARCHIVE_ERROR_READ;
+
+    while (ret == ARCHIVE_SUCCESS && (n = getline(&line, &size, f)) != -1) {
+        if (n > 0 && line[n - 1] == '\n')
+            line[--n] = '\0';
+        if (n > 0)
+            ret = archive_add(a, line);
+    }
+
+    free(line);
+    if (f != stdin)
+        fclose(f);
+    return ret;
+}
+
+/* Allocate the workers (their codecs are created by the workers) */
+static uint8_t archive_workers(archive* a) {
+    uint32_t i;
+
+    a->workers = calloc(a->n_threads, sizeof(archive_worker));
+    if (a->workers == NULL)
+        return ARCHIVE_ERROR_MEMORY;
+    for (i = 0; i < a->n_threads; ++i)
+        a->workers[i].fd = -1;
+    return ARCHIVE_SUCCESS;
+}
+
+static void archive_workers_destroy(archive* a) {
+    archive_worker* w;
+    uint32_t i;
+
+    if (a->workers == NULL)
+        return;
+
+    for (i = 0; i < a->n_threads; ++i) {
+        w = &a->workers[i];
+        if (w->fd != -1)
+            close(w->fd);
+        if (w->codec != NULL && a->type == ARCHIVE_BLOCK_LZ78)
+            lz78_destroy(w->codec);
+        else if (w->codec != NULL)
+            lz77_destroy(w->codec);
+        free(w->buf);
+        free(w->cbuf);
+        free(w->pbuf);
+    }
+    free(a->workers);
+    a->workers = NULL;
+}
+
+/* Return the first non-empty file containing the given logical offset */
+static uint32_t archive_find(archive* a, uint64_t start) {
+    uint32_t lo = 0;
+    uint32_t hi = a->n_files;
+    uint32_t mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (a->files[mid].offset + a->files[mid].size > start)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+/* Open (or reuse) the descriptor of a worker on the given file
+   Return:  0 on success, -1 on failure
+ */
+static int archive_open(archive* a, archive_worker* w, uint32_t f) {
+    char* name;
+
+    if (w->fd != -1 && w->fd_file == f)
+        return 0;
+
+    if (w->fd != -1)
+        close(w->fd);
+    w->fd = -1;
+
+    if (a->mode == ARCHIVE_MODE_CREATE) {
+        w->fd = open(a->files[f].source, O_RDONLY);
+    } else {
+        if (asprintf(&name, "%s/%s", a->dest, a->files[f].path) == -1)
+            return -1;
+        w->fd = open(name, O_WRONLY);
+        free(name);
+    }
+    w->fd_file = f;
+    return (w->fd == -1) ? -1 : 0;
+}
+
+/* Read or write a logical range spanning one or more files
+   Return:  0 on success, -1 on failure
+ */
+static int archive_range(archive* a, archive_worker* w, uint64_t start,
+                         uint32_t len, char* buf) {
+    archive_file* f;
+    uint32_t i = archive_find(a, start);
+    uint64_t off;
+    uint32_t n;
+    int ret;
+
+    while (len > 0) {
+        if (i >= a->n_files)
+            return -1;
+        f = &a->files[i];
+        if (f->size == 0) {
+            ++i;
+            continue;
+        }
+
+        off = start - f->offset;
+        n = (f->size - off < len) ? f->size - off : len;
+        if (a->mode == ARCHIVE_MODE_CREATE || f->selected) {
+            if (archive_open(a, w, i) == -1)
+                return -1;
+            if (a->mode == ARCHIVE_MODE_CREATE)
+                ret = pread_all(w->fd, buf, n, off);
+            else
+                ret = pwrite_sparse(w->fd, buf, n, off);
+            if (ret == -1)
+                return -1;
+        }
+
+        buf += n;
+        start += n;
+        len -= n;
+        ++i;
+    }
+    return 0;
+}
+
+/* Estimate the entropy (bits per byte) of a block reading only evenly
+   spaced samples of it: enough to detect compressed or encrypted data
+   Return:  the entropy, a negative value on failure
+ */
+static double archive_entropy(archive* a, archive_worker* w,
+                              archive_block* b) {
+    uint32_t count[256] = {0};
+    uint32_t step;
+    uint32_t n;
+    uint32_t total = 0;
+    uint32_t i, j;
+    double p;
+    double e = 0;
+
+    if (buffer_reserve(&w->buf, &w->buf_size, SAMPLE_SIZE) == -1)
+        return -1;
+
+    step = (b->raw_len > SAMPLE_COUNT * SAMPLE_SIZE) ?
+           b->raw_len / SAMPLE_COUNT : SAMPLE_SIZE;
+    for (i = 0; i < b->raw_len; i += step) {
+        n = (b->raw_len - i < SAMPLE_SIZE) ? b->raw_len - i : SAMPLE_SIZE;
+        if (archive_range(a, w, b->start + i, n, w->buf) == -1)
+            return -1;
+        for (j = 0; j < n; ++j)
+            ++count[(uint8_t) w->buf[j]];
+        total += n;
+    }
+
+    for (i = 0; i < 256; ++i) {
+        if (count[i]) {
+            p = (double) count[i] / total;
+            e -= p * log2(p);
+        }
+    }
+    return e;
+}
+
+/* Move a logical range between the files and the archive without going
+   through the codecs: from the files to the current position of fd
+   (create), or from fd at the offset off to the selected files (extract)
+   Return:  0 on success, -1 on failure
+ */
+static int archive_copy(archive* a, archive_worker* w, uint64_t start,
+                        uint32_t len, int fd, uint64_t off) {
+    archive_file* f;
+    uint32_t i = archive_find(a, start);
+    uint64_t pos;
+    uint32_t n;
+    int ret = 0;
+
+    while (len > 0) {
+        if (i >= a->n_files)
+            return -1;
+        f = &a->files[i];
+        if (f->size == 0) {
+            ++i;
+            continue;
+        }
+
+        pos = start - f->offset;
+        n = (f->size - pos < len) ? f->size - pos : len;
+        if (a->mode == ARCHIVE_MODE_CREATE || f->selected) {
+            if (archive_open(a, w, i) == -1)
+                return -1;
+            if (a->mode == ARCHIVE_MODE_CREATE)
+                ret = copy_fd(w->fd, pos, fd, NULL, n, &w->buf, &w->buf_size);
+            else
+                ret = copy_fd(fd, off, w->fd, &pos, n, &w->buf, &w->buf_size);
+            if (ret == -1)
+                return -1;
+        }
+
+        start += n;
+        off += n;
+        len -= n;
+        ++i;
+    }
+    return 0;
+}
+
+/* Compress a block (executed by the workers of the pool) */
+static int archive_compress_task(void* ctx, uint32_t worker, uint32_t task) {
+    archive* a = (archive*) ctx;
+    archive_worker* w = &a->workers[worker];
+    archive_block* b = &a->blocks[task];
+    uint32_t bound;
+    uint32_t n_prime = 0;
+    uint8_t ret;
+    double e;
+
+    /* Holes have no payload */
+    if (b->type == ARCHIVE_BLOCK_ZERO)
+        return 0;
+
+    if (w->codec == NULL) {
+        if (a->type == ARCHIVE_BLOCK_LZ78)
+            w->codec = lz78_new(LZ78_MODE_COMPRESS, a->param);
+        else
+            w->codec = lz77_new(LZ77_MODE_COMPRESS, LZ77_BLOCK_MIN);
+        if (w->codec == NULL)
+            return ARCHIVE_ERROR_MEMORY;
+        if ((a->flags & ARCHIVE_FLAG_WIDE) &&
+                lz78_set(w->codec, LZ78_OPTION_ALPHABET,
+                         LZ78_ALPHABET_WIDE) != LZ78_SUCCESS)
+            return ARCHIVE_ERROR_MEMORY;
+    }
+
+    /* Incompressible data is not fed to the codec: the writer copies it
+       from the file to the archive inside the kernel, the worker reads it
+       only for its checksum (in parallel with the other blocks) */
+    b->type = ARCHIVE_BLOCK_STORED;
+    b->comp_len = b->raw_len;
+    e = archive_entropy(a, w, b);
+    if (e < 0)
+        return ARCHIVE_ERROR_READ;
+    if (e > ENTROPY_STORED) {
+        if (!(a->flags & ARCHIVE_FLAG_CHECKSUM))
+            return 0;
+        if (buffer_reserve(&w->buf, &w->buf_size, b->raw_len) == -1)
+            return ARCHIVE_ERROR_MEMORY;
+        if (archive_range(a, w, b->start, b->raw_len, w->buf) == -1)
+            return ARCHIVE_ERROR_READ;
+        b->crc = crc32(w->buf, b->raw_len);
+        return 0;
+    }
+
+    bound = (a->type == ARCHIVE_BLOCK_LZ78) ? LZ78_BOUND(b->raw_len) :
+            LZ77_BOUND(b->raw_len);
+    /* The tail of the previous block is read together with the block */
+    if (task % a->chain != 0)
+        n_prime = (b[-1].raw_len < a->prime) ? b[-1].raw_len : a->prime;
+
+    /* cbuf is also the scratch buffer of the filters */
+    if (buffer_reserve(&w->buf, &w->buf_size, b->raw_len + n_prime) == -1 ||
+            buffer_reserve(&w->cbuf, &w->cbuf_size,
+                           (bound > n_prime) ? bound : n_prime) == -1)
+        return ARCHIVE_ERROR_MEMORY;
+
+    if (archive_range(a, w, b->start - n_prime, b->raw_len + n_prime,
+                      w->buf) == -1)
+        return ARCHIVE_ERROR_READ;
+    b->crc = crc32(w->buf + n_prime, b->raw_len);
+
+    /* The priming tail is filtered on its own, as the decoder does */
+    if (a->n_filters > 0) {
+        filter_encode(a->filters, a->n_filters, w->buf, n_prime, w->cbuf);
+        filter_encode(a->filters, a->n_filters, w->buf + n_prime, b->raw_len,
+                      w->cbuf);
+    }
+
+    b->type = a->type;
+    if (a->type == ARCHIVE_BLOCK_LZ78) {
+        lz78_prime(w->codec, w->buf, n_prime);
+        ret = lz78_compress_mem(w->codec, w->buf + n_prime, b->raw_len,
+                                w->cbuf, &b->comp_len);
+        ret = (ret == LZ78_SUCCESS) ? ARCHIVE_SUCCESS : ARCHIVE_ERROR_COMPRESS;
+    } else {
+        ret = lz77_compress_mem(w->codec, w->buf + n_prime, b->raw_len,
+                                w->cbuf, &b->comp_len);
+        ret = (ret == LZ77_SUCCESS) ? ARCHIVE_SUCCESS : ARCHIVE_ERROR_COMPRESS;
+    }
+    if (ret != ARCHIVE_SUCCESS)
+        return ret;
+
+    /* Blocks which expanded anyway are stored as well (unfiltered) */
+    if (b->comp_len >= b->raw_len) {
+        b->type = ARCHIVE_BLOCK_STORED;
+        b->comp_len = b->raw_len;
+        filter_decode(a->filters, a->n_filters, w->buf + n_prime, b->raw_len,
+                      w->cbuf);
+    }
+
+    /* The payload is kept until the writer reaches this block */
+    b->data = malloc(b->comp_len ? b->comp_len : 1);
+    if (b->data == NULL)
+        return ARCHIVE_ERROR_MEMORY;
+    if (b->type == ARCHIVE_BLOCK_STORED)
+        memcpy(b->data, w->buf + n_prime, b->comp_len);
+    else
+        memcpy(b->data, w->cbuf, b->comp_len);
+    return 0;
+}
+
+/* Find the first hole of at least HOLE_MIN bytes of a file from off on
+   Return:  the offset of the hole (the size of the file if there is none),
+            its end into *end
+ */
+static uint64_t archive_hole(int fd, uint64_t off, uint64_t size,
+                             uint64_t* end) {
+    off_t hole;
+    off_t data;
+
+    while (off < size) {
+        /* Filesystems without holes report a single hole at the end */
+        hole = lseek(fd, off, SEEK_HOLE);
+        if (hole == -1 || (uint64_t) hole >= size)
+            break;
+        data = lseek(fd, hole, SEEK_DATA);
+        if (data == -1 && errno != ENXIO)
+            break;
+        if (data == -1 || (uint64_t) data > size)
+            data = size;
+        if ((uint64_t) (data - hole) >= HOLE_MIN) {
+            *end = data;
+            return hole;
+        }
+        off = data;
+    }
+    return size;
+}
+
+/* Cut a logical range into blocks of the given type appended to the plan
+   Return:  0 on success, -1 on failure
+ */
+static int archive_cut(archive* a, uint32_t* size, uint64_t start,
+                       uint64_t len, uint8_t type) {
+    uint32_t max = (type == ARCHIVE_BLOCK_ZERO) ? ZERO_BLOCK_MAX : a->b_size;
+    archive_block* b;
+    uint32_t n;
+
+    while (len > 0) {
+        if (a->n_blocks + 1 >= *size) {
+            if (*size > UINT32_MAX / 2)
+                return -1;
+            n = (*size > 0) ? 2 * *size : 64;
+            b = realloc(a->blocks, (size_t) n * sizeof(archive_block));
+            if (b == NULL)
+                return -1;
+            memset(b + *size, 0, (size_t) (n - *size) * sizeof(archive_block));
+            a->blocks = b;
+            *size = n;
+        }
+
+        b = &a->blocks[a->n_blocks++];
+        b->start = start;
+        b->raw_len = (len < max) ? len : max;
+        b->type = type;
+        start += b->raw_len;
+        len -= b->raw_len;
+    }
+    return 0;
+}
+
+/* Split the files into blocks: the data between the holes is cut into blocks
+   of b_size bytes, across the files in solid mode */
+static uint8_t archive_plan(archive* a) {
+    archive_file* f;
+    uint64_t run = 0;
+    uint64_t off;
+    uint64_t hole;
+    uint64_t end = 0;
+    uint32_t size = 0;
+    uint32_t i;
+    int fd;
+
+    a->total = 0;
+    for (i = 0; i < a->n_files; ++i) {
+        a->files[i].offset = a->total;
+        a->total += a->files[i].size;
+    }
+
+    /* run is the start of the data not cut into blocks yet */
+    a->n_blocks = 0;
+    for (i = 0; i < a->n_files; ++i) {
+        f = &a->files[i];
+        if (!(a->flags & ARCHIVE_FLAG_SOLID))
+            run = f->offset;
+
+        /* A file which cannot be opened is read (and fails) as data */
+        fd = (f->size >= HOLE_MIN) ? open(f->source, O_RDONLY) : -1;
+        for (off = 0; fd != -1 && off < f->size; off = end) {
+            hole = archive_hole(fd, off, f->size, &end);
+            if (hole == f->size)
+                break;
+            if (archive_cut(a, &size, run, f->offset + hole - run, 0) == -1 ||
+                    archive_cut(a, &size, f->offset + hole, end - hole,
+                                ARCHIVE_BLOCK_ZERO) == -1) {
+                close(fd);
+                return ARCHIVE_ERROR_MEMORY;
+            }
+            run = f->offset + end;
+        }
+        if (fd != -1)
+            close(fd);
+
+        if (!(a->flags & ARCHIVE_FLAG_SOLID) &&
+                archive_cut(a, &size, run, f->offset + f->size - run, 0) == -1)
+            return ARCHIVE_ERROR_MEMORY;
+    }
+
+    if ((a->flags & ARCHIVE_FLAG_SOLID) &&
+            archive_cut(a, &size, run, a->total - run, 0) == -1)
+        return ARCHIVE_ERROR_MEMORY;
+    return ARCHIVE_SUCCESS;
+}
+
+/* Append a block of a file holding the given number of records
+   Return:  0 on success, -1 on failure
+ */
+static int archive_batch(archive* a, uint32_t* size, archive_file* f,
+                         uint64_t start, uint64_t end, uint32_t records) {
+    if (archive_cut(a, size, f->offset + start, end - start, 0) == -1)
+        return -1;
+    a->blocks[a->n_blocks - 1].records = records;
+    return 0;
+}
+
+/* Split the files into blocks of batch records (lines), or of at most b_size
+   bytes cut after their last record, counting the records ending in each
+   block; the last line of a file ends a record even without its newline */
+static uint8_t archive_plan_records(archive* a) {
+    archive_file* f;
+    char* buf;
+    char* p;
+    char* q;
+    uint64_t start;
+    uint64_t last;
+    uint64_t off;
+    uint64_t end;
+    uint32_t size = 0;
+    uint32_t len;
+    uint32_t n;
+    uint32_t i;
+    int fd = -1;
+    uint8_t ret = ARCHIVE_ERROR_MEMORY;
+
+    a->total = 0;
+    for (i = 0; i < a->n_files; ++i) {
+        a->files[i].offset = a->total;
+        a->total += a->files[i].size;
+    }
+
+    buf = malloc(RECORD_BUFFER_SIZE);
+    if (buf == NULL)
+        return ARCHIVE_ERROR_MEMORY;
+
+    /* start is the start of the current block, last the end of its last
+       record, n the number of its records */
+    a->n_blocks = 0;
+    for (i = 0; i < a->n_files; ++i) {
+        f = &a->files[i];
+        if (f->size == 0)
+            continue;
+        fd = open(f->source, O_RDONLY);
+        if (fd == -1) {
+            ret = ARCHIVE_ERROR_READ;
+            goto out;
+        }
+
+        start = last = off = 0;
+        n = 0;
+        for (; off < f->size; off += len) {
+            len = (f->size - off < RECORD_BUFFER_SIZE) ? f->size - off :
+                  RECORD_BUFFER_SIZE;
+            if (pread_all(fd, buf, len, off) == -1) {
+                ret = ARCHIVE_ERROR_READ;
+                goto out;
+            }
+
+            for (p = buf; p < buf + len; p = q + 1) {
+                q = memchr(p, '\n', buf + len - p);
+                end = (q == NULL) ? off + len : off + (q - buf) + 1;
+
+                /* A record longer than a block is cut anywhere */
+                while (end - start > a->b_size) {
+                    if (archive_batch(a, &size, f, start, (last > start) ?
+                                      last : start + a->b_size, n) == -1)
+                        goto out;
+                    start = (last > start) ? last : start + a->b_size;
+                    n = 0;
+                }
+                if (q == NULL)
+                    break;
+
+                last = end;
+                if (++n == a->batch) {
+                    if (archive_batch(a, &size, f, start, end, n) == -1)
+                        goto out;
+                    start = end;
+                    n = 0;
+                }
+            }
+        }
+
+        if (start < f->size && archive_batch(a, &size, f, start, f->size,
+                                             n + (last != f->size)) == -1)
+            goto out;
+        close(fd);
+        fd = -1;
+    }
+    ret = ARCHIVE_SUCCESS;
+
+out:
+    if (fd != -1)
+        close(fd);
+    free(buf);
+    return ret;
+}
+
+/* Write the index and the trailer */
+static uint8_t archive_write_index(archive* a, int fd_out, uint64_t pos) {
+    uint8_t* index;
+    uint8_t* p;
+    size_t size = TRAILER_SIZE;
+    size_t len;
+    uint32_t i;
+    uint8_t ret = ARCHIVE_SUCCESS;
+
+    for (i = 0; i < a->n_files; ++i)
+        size += FILE_ENTRY_SIZE + strlen(a->files[i].path);
+    size += (size_t) a->n_blocks * BLOCK_ENTRY_SIZE;
+    if (a->flags & ARCHIVE_FLAG_RECORDS)
+        size += (size_t) a->n_blocks * RECORD_ENTRY_SIZE;
+    if (a->flags & ARCHIVE_FLAG_CHECKSUM)
+        size += (size_t) a->n_blocks * CHECKSUM_ENTRY_SIZE;
+
+    p = index = calloc(1, size);
+    if (index == NULL)
+        return ARCHIVE_ERROR_MEMORY;
+
+    for (i = 0; i < a->n_files; ++i) {
+        len = strlen(a->files[i].path);
+        put16(p, len);
+        put32(p + 4, a->files[i].mode);
+        put64(p + 8, a->files[i].size);
+        put64(p + 16, a->files[i].offset);
+        memcpy(p + FILE_ENTRY_SIZE, a->files[i].path, len);
+        p += FILE_ENTRY_SIZE + len;
+    }
+
+    for (i = 0; i < a->n_blocks; ++i) {
+        put64(p, a->blocks[i].offset);
+        put32(p + 8, a->blocks[i].comp_len);
+        put32(p + 12, a->blocks[i].raw_len);
+        p[16] = a->blocks[i].type;
+        p += BLOCK_ENTRY_SIZE;
+    }
+
+    for (i = 0; (a->flags & ARCHIVE_FLAG_RECORDS) && i < a->n_blocks; ++i) {
+        put32(p, a->blocks[i].records);
+        p += RECORD_ENTRY_SIZE;
+    }
+
+    for (i = 0; (a->flags & ARCHIVE_FLAG_CHECKSUM) && i < a->n_blocks; ++i) {
+        put32(p, a->blocks[i].crc);
+        p += CHECKSUM_ENTRY_SIZE;
+    }
+
+    put64(p, pos);
+    put32(p + 8, a->n_files);
+    put32(p + 12, a->n_blocks);
+    memcpy(p + 16, ARCHIVE_MAGIC, 4);
+
+    if (write_all(fd_out, (char*) index, size) == -1)
+        ret = ARCHIVE_ERROR_WRITE;
+    free(index);
+    return ret;
+}
+
+uint8_t archive_create(archive* a, int fd_out) {
+    uint8_t header[HEADER_SIZE] = {0};
+    uint64_t pos = HEADER_SIZE;
+    archive_block* b;
+    archive_worker writer = {0};
+    pool* p = NULL;
+    uint32_t i;
+    uint8_t ret;
+    int r;
+
+    if (a->mode != ARCHIVE_MODE_CREATE)
+        return ARCHIVE_ERROR_OPTION;
+
+    /* Every parameter shaping the output is stored into the header (the
+       number of workers is not one of them), with the effective values so
+       that the archive does not depend on the defaults of the algorithms */
+    if (a->type == ARCHIVE_BLOCK_LZ78 && a->param == 0)
+        a->param = DICT_SIZE_DEFAULT;
+
+    /* The 16-bit alphabet is supported only by lz78 blocks, which need
+       larger dictionaries */
+    if (a->type != ARCHIVE_BLOCK_LZ78)
+        a->flags &= ~ARCHIVE_FLAG_WIDE;
+    if ((a->flags & ARCHIVE_FLAG_WIDE) && a->param < DICT_SIZE_MIN_WIDE)
+        a->param = DICT_SIZE_MIN_WIDE;
+
+    /* Priming is supported only by lz78 blocks */
+    if (a->type != ARCHIVE_BLOCK_LZ78)
+        a->prime = 0;
+    a->chain = (a->prime > 0) ? ARCHIVE_PRIME_CHAIN : 1;
+
+    if (a->n_filters > 0)
+        a->flags |= ARCHIVE_FLAG_FILTER;
+
+    /* Batches of records never span two files */
+    if (a->flags & ARCHIVE_FLAG_RECORDS) {
+        a->flags &= ~ARCHIVE_FLAG_SOLID;
+        ret = archive_plan_records(a);
+    } else {
+        ret = archive_plan(a);
+    }
+    if (ret != ARCHIVE_SUCCESS)
+        return ret;
+
+    ret = archive_workers(a);
+    if (ret != ARCHIVE_SUCCESS)
+        return ret;
+    writer.fd = -1;
+
+    memcpy(header, ARCHIVE_MAGIC, 4);
+    header[4] = ARCHIVE_VERSION;
+    header[5] = a->type;
+    put16(header + 6, a->flags);
+    put32(header + 8, a->param);
+    put32(header + 12, a->b_size);
+    put32(header + 16, a->prime);
+    put32(header + 20, a->chain);
+    for (i = 0; i < a->n_filters; ++i) {
+        header[HEADER_FILTERS + 2 * i] = a->filters[i].kind;
+        header[HEADER_FILTERS + 2 * i + 1] = a->filters[i].stride;
+    }
+    if (write_all(fd_out, (char*) header, HEADER_SIZE) == -1) {
+        ret = ARCHIVE_ERROR_WRITE;
+        goto out;
+    }
+
+    /* Blocks are compressed out of order but written in order: the window
+       bounds the memory held by the completed payloads */
+    if (a->n_blocks > 0) {
+        p = pool_start(a->n_threads, a->n_blocks, archive_compress_task, a,
+                       2 * a->n_threads, a->pool_flags);
+        if (p == NULL) {
+            ret = ARCHIVE_ERROR_THREAD;
+            goto out;
+        }
+    }
+
+    for (i = 0; i < a->n_blocks; ++i) {
+        b = &a->blocks[i];
+        r = pool_wait(p, i);
+        if (r != 0)
+            break;
+
+        b->offset = pos;
+        if (b->type == ARCHIVE_BLOCK_ZERO)
+            r = 0;
+        else if (b->data == NULL)
+            r = archive_copy(a, &writer, b->start, b->raw_len, fd_out, 0);
+        else
+            r = write_all(fd_out, b->data, b->comp_len);
+        if (r == -1) {
+            ret = ARCHIVE_ERROR_WRITE;
+            pool_abort(p);
+            break;
+        }
+        pos += b->comp_len;
+        free(b->data);
+        b->data = NULL;
+        pool_retire(p, i);
+    }
+
+    if (p != NULL) {
+        r = pool_finish(p);
+        if (ret == ARCHIVE_SUCCESS && r != 0)
+            ret = r;
+    }
+
+    if (ret == ARCHIVE_SUCCESS)
+        ret = archive_write_index(a, fd_out, pos);
+
+out:
+    for (i = 0; i < a->n_blocks; ++i) {
+        free(a->blocks[i].data);
+        a->blocks[i].data = NULL;
+    }
+    if (writer.fd != -1)
+        close(writer.fd);
+    free(writer.buf);
+    archive_workers_destroy(a);
+    return ret;
+}
+
+/* Load and validate the index of the archive */
+static uint8_t archive_read_index(archive* a, int fd_in) {
+    uint8_t header[HEADER_SIZE];
+    uint8_t trailer[TRAILER_SIZE];
+    uint8_t* index;
+    uint8_t* p;
+    uint8_t* end;
+    struct stat st;
+    uint64_t index_off;
+    uint64_t total = 0;
+    uint32_t n_files;
+    uint32_t n_blocks;
+    uint32_t len;
+    uint32_t i;
+    archive_file* f;
+    archive_block* b;
+    uint8_t ret = ARCHIVE_ERROR_FORMAT;
+
+    if (fstat(fd_in, &st) == -1 || !S_ISREG(st.st_mode))
+        return ARCHIVE_ERROR_READ;
+
+    if (st.st_size < HEADER_SIZE + TRAILER_SIZE)
+        return ARCHIVE_ERROR_FORMAT;
+
+    if (pread_all(fd_in, (char*) header, HEADER_SIZE, 0) == -1 ||
+            pread_all(fd_in, (char*) trailer, TRAILER_SIZE,
+                      st.st_size - TRAILER_SIZE) == -1)
+        return ARCHIVE_ERROR_READ;
+
+    if (memcmp(header, ARCHIVE_MAGIC, 4) != 0 ||
+            memcmp(trailer + 16, ARCHIVE_MAGIC, 4) != 0 ||
+            header[4] != ARCHIVE_VERSION)
+        return ARCHIVE_ERROR_FORMAT;
+
+    if ((get16(header + 6) &
+            ~(ARCHIVE_FLAG_SOLID | ARCHIVE_FLAG_FILTER |
+              ARCHIVE_FLAG_WIDE | ARCHIVE_FLAG_RECORDS |
+              ARCHIVE_FLAG_CHECKSUM)) != 0 ||
+            get32(header + 16) > ARCHIVE_PRIME_MAX ||
+            (get32(header + 16) > 0 && get32(header + 20) == 0))
+        return ARCHIVE_ERROR_FORMAT;
+
+    a->type = header[5];
+    a->flags = get16(header + 6);
+    a->param = get32(header + 8);
+    a->b_size = get32(header + 12);
+    a->prime = get32(header + 16);
+    a->chain = (a->prime > 0) ? get32(header + 20) : 1;
+
+    a->n_filters = 0;
+    while ((a->flags & ARCHIVE_FLAG_FILTER) &&
+            a->n_filters < FILTER_CHAIN_MAX &&
+            header[HEADER_FILTERS + 2 * a->n_filters] != FILTER_NONE) {
+        a->filters[a->n_filters].kind = header[HEADER_FILTERS +
+                                               2 * a->n_filters];
+        a->filters[a->n_filters].stride = header[HEADER_FILTERS +
+                                                 2 * a->n_filters + 1];
+        if (filter_check(&a->filters[a->n_filters]) == -1)
+            return ARCHIVE_ERROR_FORMAT;
+        ++a->n_filters;
+    }
+    index_off = get64(trailer);
+    n_files = get32(trailer + 8);
+    n_blocks = get32(trailer + 12);
+
+    if (index_off < HEADER_SIZE ||
+            index_off > (uint64_t) st.st_size - TRAILER_SIZE)
+        return ARCHIVE_ERROR_FORMAT;
+
+    len = st.st_size - TRAILER_SIZE - index_off;
+    if ((uint64_t) n_files * FILE_ENTRY_SIZE +
+            (uint64_t) n_blocks * BLOCK_ENTRY_SIZE > len)
+        return ARCHIVE_ERROR_FORMAT;
+
+    index = malloc(len ? len : 1);
+    if (index == NULL)
+        return ARCHIVE_ERROR_MEMORY;
+    if (pread_all(fd_in, (char*) index, len, index_off) == -1) {
+        free(index);
+        return ARCHIVE_ERROR_READ;
+    }
+
+    a->files = calloc(n_files + 1, sizeof(archive_file));
+    a->blocks = calloc(n_blocks + 1, sizeof(archive_block));
+    if (a->files == NULL || a->blocks == NULL) {
+        free(index);
+        return ARCHIVE_ERROR_MEMORY;
+    }
+    a->files_size = n_files + 1;
+
+    p = index;
+    end = index + len;
+    for (i = 0; i < n_files; ++i) {
+        if (end - p < FILE_ENTRY_SIZE)
+            goto out;
+        f = &a->files[i];
+        len = get16(p);
+        f->mode = get32(p + 4) & 07777;
+        f->size = get64(p + 8);
+        f->offset = get64(p + 16);
+        p += FILE_ENTRY_SIZE;
+        if ((size_t) (end - p) < len || f->offset != total)
+            goto out;
+
+        f->source = malloc(len + 1);
+        if (f->source == NULL) {
+            ret = ARCHIVE_ERROR_MEMORY;
+            goto out;
+        }
+        memcpy(f->source, p, len);
+        f->source[len] = '\0';
+        f->path = f->source;
+        ++(a->n_files);
+        p += len;
+        total += f->size;
+
+        if (strlen(f->path) != len || archive_check_path(f->path) == -1) {
+            ret = ARCHIVE_ERROR_PATH;
+            goto out;
+        }
+    }
+    a->total = total;
+
+    if (end - p != (ptrdiff_t) n_blocks * (BLOCK_ENTRY_SIZE +
+            ((a->flags & ARCHIVE_FLAG_RECORDS) ? RECORD_ENTRY_SIZE : 0) +
+            ((a->flags & ARCHIVE_FLAG_CHECKSUM) ? CHECKSUM_ENTRY_SIZE : 0)))
+        goto out;
+
+    total = 0;
+    for (i = 0; i < n_blocks; ++i) {
+        b = &a->blocks[i];
+        b->offset = get64(p);
+        b->comp_len = get32(p + 8);
+        b->raw_len = get32(p + 12);
+        b->type = p[16];
+        b->start = total;
+        p += BLOCK_ENTRY_SIZE;
+        total += b->raw_len;
+
+        if (b->offset < HEADER_SIZE || b->offset > index_off ||
+                b->comp_len > index_off - b->offset ||
+                b->raw_len > ((b->type == ARCHIVE_BLOCK_ZERO) ?
+                              ZERO_BLOCK_MAX : ARCHIVE_BLOCK_MAX) ||
+                (b->type != ARCHIVE_BLOCK_LZ78 &&
+                 b->type != ARCHIVE_BLOCK_LZ77 &&
+                 b->type != ARCHIVE_BLOCK_STORED &&
+                 b->type != ARCHIVE_BLOCK_ZERO) ||
+                (b->type == ARCHIVE_BLOCK_STORED &&
+                 b->comp_len != b->raw_len) ||
+                (b->type == ARCHIVE_BLOCK_ZERO && b->comp_len != 0))
+            goto out;
+    }
+    a->n_blocks = n_blocks;
+
+    for (i = 0; (a->flags & ARCHIVE_FLAG_RECORDS) && i < n_blocks; ++i) {
+        a->blocks[i].records = get32(p);
+        p += RECORD_ENTRY_SIZE;
+    }
+
+    for (i = 0; (a->flags & ARCHIVE_FLAG_CHECKSUM) && i < n_blocks; ++i) {
+        a->blocks[i].crc = get32(p);
+        p += CHECKSUM_ENTRY_SIZE;
+    }
+
+    if (total != a->total)
+        goto out;
+
+    ret = ARCHIVE_SUCCESS;
+
+out:
+    free(index);
+    return ret;
+}
+
+/* Create the directories leading to a file of the destination */
+static int archive_mkdirs(char* name) {
+    char* p = name;
+
+    while ((p = strchr(p + 1, '/')) != NULL) {
+        *p = '\0';
+        if (mkdir(name, 0755) == -1 && errno != EEXIST) {
+            *p = '/';
+            return -1;
+        }
+        *p = '/';
+    }
+    return 0;
+}
+
+/* Select the files matching the members (every file if there are none) and
+   the blocks overlapping the selected files */
+static uint8_t archive_select(archive* a) {
+    archive_file* f;
+    archive_block* b;
+    uint64_t end;
+    uint32_t i, j;
+    size_t n;
+    int found;
+
+    for (i = 0; i < a->n_files; ++i)
+        a->files[i].selected = (a->n_members == 0);
+
+    for (j = 0; j < a->n_members; ++j) {
+        n = strlen(a->members[j]);
+        found = 0;
+        for (i = 0; i < a->n_files; ++i) {
+            f = &a->files[i];
+            if (strncmp(f->path, a->members[j], n) == 0 &&
+                    (f->path[n] == '\0' || f->path[n] == '/' || n == 0)) {
+                f->selected = 1;
+                found = 1;
+            }
+        }
+        if (!found)
+            return ARCHIVE_ERROR_PATH;
+    }
+
+    for (j = 0; j < a->n_blocks; ++j) {
+        b = &a->blocks[j];
+        end = b->start + b->raw_len;
+        b->needed = 0;
+        for (i = archive_find(a, b->start);
+                i < a->n_files && a->files[i].offset < end; ++i) {
+            if (a->files[i].selected && a->files[i].size > 0) {
+                b->needed = 1;
+                break;
+            }
+        }
+    }
+    return ARCHIVE_SUCCESS;
+}
+
+/* Create every selected file of the archive with its final size */
+static uint8_t archive_prepare(archive* a) {
+    archive_file* f;
+    char* name;
+    uint32_t i;
+    int fd;
+
+    if (mkdir(a->dest, 0755) == -1 && errno != EEXIST)
+        return ARCHIVE_ERROR_PATH;
+
+    for (i = 0; i < a->n_files; ++i) {
+        f = &a->files[i];
+        if (!f->selected)
+            continue;
+        if (asprintf(&name, "%s/%s", a->dest, f->path) == -1)
+            return ARCHIVE_ERROR_MEMORY;
+
+        if (archive_mkdirs(name) == -1) {
+            free(name);
+            return ARCHIVE_ERROR_PATH;
+        }
+
+        fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, f->mode | 0200);
+        free(name);
+        if (fd == -1)
+            return ARCHIVE_ERROR_WRITE;
+        if (ftruncate(fd, f->size) == -1 || fchmod(fd, f->mode) == -1) {
+            close(fd);
+            return ARCHIVE_ERROR_WRITE;
+        }
+        close(fd);
+    }
+    return ARCHIVE_SUCCESS;
+}
+
+/* Decompress a block into the buffer of a worker, verifying its checksum
+   Return:  0 on success, an archive-level error code otherwise
+ */
+static int archive_decode(archive* a, archive_worker* w, archive_block* b,
+                          uint32_t n_prime) {
+    uint32_t n;
+    uint8_t ret;
+
+    if (b->type != a->type)
+        return ARCHIVE_ERROR_FORMAT;
+
+    /* buf and cbuf are also the scratch buffers of the filters */
+    if (buffer_reserve(&w->buf, &w->buf_size,
+                       (b->raw_len > n_prime) ? b->raw_len : n_prime) == -1 ||
+            buffer_reserve(&w->cbuf, &w->cbuf_size,
+                           (b->comp_len > b->raw_len) ? b->comp_len :
+                           b->raw_len) == -1)
+        return ARCHIVE_ERROR_MEMORY;
+
+    if (pread_all(a->fd, w->cbuf, b->comp_len, b->offset) == -1)
+        return ARCHIVE_ERROR_READ;
+
+    if (b->type == ARCHIVE_BLOCK_LZ78) {
+        n = b->raw_len;
+        /* pbuf holds the decoded tail: the priming data is its filtered
+           version, pbuf is refilled after the block anyway */
+        if (a->n_filters > 0)
+            filter_encode(a->filters, a->n_filters, w->pbuf, n_prime, w->buf);
+        lz78_prime(w->codec, w->pbuf, n_prime);
+        ret = lz78_decompress_mem(w->codec, w->cbuf, b->comp_len, w->buf, &n);
+        if (ret != LZ78_SUCCESS || n != b->raw_len)
+            return ARCHIVE_ERROR_DECOMPRESS;
+    } else {
+        ret = lz77_decompress_mem(w->codec, w->cbuf, b->comp_len, w->buf,
+                                  b->raw_len);
+        if (ret != LZ77_SUCCESS)
+            return ARCHIVE_ERROR_DECOMPRESS;
+    }
+
+    if (a->n_filters > 0)
+        filter_decode(a->filters, a->n_filters, w->buf, b->raw_len, w->cbuf);
+
+    if ((a->flags & ARCHIVE_FLAG_CHECKSUM) &&
+            crc32(w->buf, b->raw_len) != b->crc)
+        return ARCHIVE_ERROR_CHECKSUM;
+    return 0;
+}
+
+/* Create the decoder of a worker (and the buffer of its priming data)
+   Return:  0 on success, an archive-level error code otherwise
+ */
+static int archive_decoder(archive* a, archive_worker* w) {
+    if (w->codec != NULL)
+        return 0;
+
+    if (a->type == ARCHIVE_BLOCK_LZ78)
+        w->codec = lz78_new(LZ78_MODE_DECOMPRESS, a->param);
+    else
+        w->codec = lz77_new(LZ77_MODE_DECOMPRESS, LZ77_BLOCK_MIN);
+    if (w->codec == NULL)
+        return ARCHIVE_ERROR_MEMORY;
+    if (a->prime > 0 && (w->pbuf = malloc(a->prime)) == NULL)
+        return ARCHIVE_ERROR_MEMORY;
+    return 0;
+}
+
+/* Decompress a chain of blocks (executed by the workers of the pool): every
+   block is primed with the tail of the previous one, and the blocks are
+   decoded up to the last one needed */
+static int archive_extract_task(void* ctx, uint32_t worker, uint32_t task) {
+    archive* a = (archive*) ctx;
+    archive_worker* w = &a->workers[worker];
+    archive_block* b;
+    uint32_t first = task * a->chain;
+    uint32_t last = first + a->chain;
+    uint32_t n_prime = 0;
+    uint32_t i;
+    int ret;
+
+    last = (last > a->n_blocks) ? a->n_blocks : last;
+    while (last > first && !a->blocks[last - 1].needed)
+        --last;
+    if (last == first)
+        return 0;
+
+    ret = archive_decoder(a, w);
+    if (ret != 0)
+        return ret;
+
+    for (i = first; i < last; ++i) {
+        b = &a->blocks[i];
+
+        /* The files are created as holes: zero blocks are not written */
+        if (b->type == ARCHIVE_BLOCK_ZERO) {
+            n_prime = (b->raw_len < a->prime) ? b->raw_len : a->prime;
+            if (a->prime > 0)
+                memset(w->pbuf, 0, n_prime);
+            continue;
+        }
+
+        /* Stored blocks go from the archive to the files inside the kernel,
+           once their checksum (if any) has been verified by reading them;
+           otherwise only the priming tail is read */
+        if (b->type == ARCHIVE_BLOCK_STORED) {
+            if ((a->flags & ARCHIVE_FLAG_CHECKSUM) && (b->needed || a->test)) {
+                if (buffer_reserve(&w->buf, &w->buf_size, b->raw_len) == -1)
+                    return ARCHIVE_ERROR_MEMORY;
+                if (pread_all(a->fd, w->buf, b->raw_len, b->offset) == -1)
+                    return ARCHIVE_ERROR_READ;
+                if (crc32(w->buf, b->raw_len) != b->crc)
+                    return ARCHIVE_ERROR_CHECKSUM;
+            }
+            if (b->needed && !a->test && archive_copy(a, w, b->start,
+                                                      b->raw_len, a->fd,
+                                                      b->offset) == -1)
+                return ARCHIVE_ERROR_WRITE;
+            if (a->prime > 0) {
+                n_prime = (b->raw_len < a->prime) ? b->raw_len : a->prime;
+                if (pread_all(a->fd, w->pbuf, n_prime,
+                              b->offset + b->raw_len - n_prime) == -1)
+                    return ARCHIVE_ERROR_READ;
+            }
+            continue;
+        }
+
+        ret = archive_decode(a, w, b, n_prime);
+        if (ret != 0)
+            return ret;
+
+        if (b->needed && !a->test &&
+                archive_range(a, w, b->start, b->raw_len, w->buf) == -1)
+            return ARCHIVE_ERROR_WRITE;
+
+        if (a->prime > 0) {
+            n_prime = (b->raw_len < a->prime) ? b->raw_len : a->prime;
+            memcpy(w->pbuf, w->buf + b->raw_len - n_prime, n_prime);
+        }
+    }
+    return 0;
+}
+
+uint8_t archive_extract(archive* a, int fd_in, const char* dest) {
+    pool* p;
+    uint8_t ret;
+    int r;
+
+    if (a->mode != ARCHIVE_MODE_EXTRACT)
+        return ARCHIVE_ERROR_OPTION;
+
+    ret = archive_read_index(a, fd_in);
+    if (ret != ARCHIVE_SUCCESS)
+        return ret;
+
+    if (a->type != ARCHIVE_BLOCK_LZ78 && a->type != ARCHIVE_BLOCK_LZ77)
+        return ARCHIVE_ERROR_FORMAT;
+
+    a->fd = fd_in;
+    a->dest = (dest == NULL) ? "." : dest;
+
+    ret = archive_select(a);
+    if (ret != ARCHIVE_SUCCESS)
+        return ret;
+
+    ret = a->test ? ARCHIVE_SUCCESS : archive_prepare(a);
+    if (ret != ARCHIVE_SUCCESS)
+        return ret;
+
+    if (a->n_blocks == 0)
+        return ARCHIVE_SUCCESS;
+
+    ret = archive_workers(a);
+    if (ret != ARCHIVE_SUCCESS)
+        return ret;
+
+    /* Blocks are written in place: no ordering is needed */
+    p = pool_start(a->n_threads, (a->n_blocks + a->chain - 1) / a->chain,
+                   archive_extract_task, a, 0, a->pool_flags);
+    if (p == NULL) {
+        archive_workers_destroy(a);
+        return ARCHIVE_ERROR_THREAD;
+    }
+
+    r = pool_finish(p);
+    archive_workers_destroy(a);
+    return (r != 0) ? r : ARCHIVE_SUCCESS;
+}
+
+uint8_t archive_test(archive* a, int fd_in) {
+    a->test = 1;
+    return archive_extract(a, fd_in, NULL);
+}
+
+/* Write the records of a decoded block numbered from first to last, t being
+   the number of records ended before it
+   Return:  0 on success, -1 on failure
+ */
+static int archive_emit(archive* a, archive_block* b, const char* data,
+                        uint64_t* t, uint64_t first, uint64_t last,
+                        int fd_out) {
+    archive_file* f = &a->files[archive_find(a, b->start)];
+    const char* p = data;
+    const char* end = data + b->raw_len;
+    const char* q;
+
+    while (p < end && *t < last) {
+        q = memchr(p, '\n', end - p);
+        q = (q == NULL) ? end : q + 1;
+        if (*t + 1 >= first && write_all(fd_out, p, q - p) == -1)
+            return -1;
+        if (q[-1] == '\n')
+            ++(*t);
+        p = q;
+    }
+
+    /* The last line of a file ends a record even without its newline */
+    if (b->raw_len > 0 && end[-1] != '\n' && *t < last &&
+            b->start + b->raw_len == f->offset + f->size) {
+        if (*t + 1 >= first && write_all(fd_out, "\n", 1) == -1)
+            return -1;
+        ++(*t);
+    }
+    return 0;
+}
+
+uint8_t archive_records(archive* a, int fd_in, uint64_t first, uint64_t last,
+                        int fd_out) {
+    archive_worker* w;
+    archive_block* b;
+    uint64_t t = 0;
+    uint32_t n_prime = 0;
+    uint32_t i, j, k;
+    uint8_t ret;
+
+    if (a->mode != ARCHIVE_MODE_EXTRACT || first == 0 || first > last)
+        return ARCHIVE_ERROR_OPTION;
+
+    ret = archive_read_index(a, fd_in);
+    if (ret != ARCHIVE_SUCCESS)
+        return ret;
+
+    if (a->type != ARCHIVE_BLOCK_LZ78 && a->type != ARCHIVE_BLOCK_LZ77)
+        return ARCHIVE_ERROR_FORMAT;
+    if (!(a->flags & ARCHIVE_FLAG_RECORDS))
+        return ARCHIVE_ERROR_OPTION;
+    a->fd = fd_in;
+
+    /* From the block ending the record preceding first (where first
+       starts) to the block ending last */
+    for (j = 0; j < a->n_blocks && t + a->blocks[j].records < first - 1; ++j)
+        t += a->blocks[j].records;
+    if (j == a->n_blocks)
+        return ARCHIVE_SUCCESS;
+    for (k = j; k + 1 < a->n_blocks && t + a->blocks[k].records < last; ++k)
+        t += a->blocks[k].records;
+    for (t = 0, i = 0; i < j; ++i)
+        t += a->blocks[i].records;
+
+    a->n_threads = 1;
+    ret = archive_workers(a);
+    if (ret != ARCHIVE_SUCCESS)
+        return ret;
+    w = &a->workers[0];
+    ret = archive_decoder(a, w);
+
+    /* Blocks are primed from the start of their chain */
+    for (i = j - j % a->chain; ret == 0 && i <= k; ++i) {
+        b = &a->blocks[i];
+        if (i % a->chain == 0)
+            n_prime = 0;
+        if (b->type == ARCHIVE_BLOCK_STORED || b->type == ARCHIVE_BLOCK_ZERO) {
+            if (buffer_reserve(&w->buf, &w->buf_size, b->raw_len) == -1) {
+                ret = ARCHIVE_ERROR_MEMORY;
+                break;
+            }
+            if (b->type == ARCHIVE_BLOCK_ZERO)
+                memset(w->buf, 0, b->raw_len);
+            else if (pread_all(a->fd, w->buf, b->raw_len, b->offset) == -1)
+                ret = ARCHIVE_ERROR_READ;
+            else if ((a->flags & ARCHIVE_FLAG_CHECKSUM) &&
+                     crc32(w->buf, b->raw_len) != b->crc)
+                ret = ARCHIVE_ERROR_CHECKSUM;
+        } else {
+            ret = archive_decode(a, w, b, n_prime);
+        }
+        if (ret != 0)
+            break;
+
+        if (a->prime > 0) {
+            n_prime = (b->raw_len < a->prime) ? b->raw_len : a->prime;
+            memcpy(w->pbuf, w->buf + b->raw_len - n_prime, n_prime);
+        }
+        if (i >= j && archive_emit(a, b, w->buf, &t, first, last,
+                                   fd_out) == -1)
+            ret = ARCHIVE_ERROR_WRITE;
+    }
+
+    archive_workers_destroy(a);
+    return (ret != 0) ? ret : ARCHIVE_SUCCESS;
+}
+
+void archive_destroy(archive* a) {
+    uint32_t i;
+
+    if (a == NULL)
+        return;
+
+    for (i = 0; i < a->n_files; ++i)
+        free(a->files[i].source);
+    for (i = 0; i < a->n_members; ++i)
+        free(a->members[i]);
+    free(a->members);
+    free(a->files);
+    free(a->blocks);
+    free(a);
+}
@@ -0,0 +1,132 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ARCHIVE_H
+#define __ARCHIVE_H
+
+#include <stdint.h>
+
+/* Modes of the archive */
+#define ARCHIVE_MODE_CREATE       0
+#define ARCHIVE_MODE_EXTRACT      1
+
+/* Types of the blocks */
+#define ARCHIVE_BLOCK_LZ78        1
+#define ARCHIVE_BLOCK_LZ77        2
+#define ARCHIVE_BLOCK_STORED      3
+#define ARCHIVE_BLOCK_ZERO        4
+
+/* List of archive options */
+#define ARCHIVE_OPTION_THREADS    1
+#define ARCHIVE_OPTION_BLOCK_SIZE 2
+#define ARCHIVE_OPTION_SOLID      3
+#define ARCHIVE_OPTION_PRIME      4
+#define ARCHIVE_OPTION_NUMA       5
+#define ARCHIVE_OPTION_FILTER     6
+#define ARCHIVE_OPTION_ALPHABET   7
+#define ARCHIVE_OPTION_RECORDS    8
+#define ARCHIVE_OPTION_CHECKSUM   9
+
+/* Size of the blocks the files are split into */
+#define ARCHIVE_BLOCK_MIN         65536
+#define ARCHIVE_BLOCK_DEFAULT     4194304
+#define ARCHIVE_BLOCK_MAX         67108864
+
+/* Maximum amount of data of the previous block priming a lz78 block */
+#define ARCHIVE_PRIME_MAX         1048576
+
+/* List of archive-level return codes */
+#define ARCHIVE_SUCCESS           30
+#define ARCHIVE_ERROR_MEMORY      31
+#define ARCHIVE_ERROR_READ        32
+#define ARCHIVE_ERROR_WRITE       33
+#define ARCHIVE_ERROR_COMPRESS    34
+#define ARCHIVE_ERROR_DECOMPRESS  35
+#define ARCHIVE_ERROR_FORMAT      36
+#define ARCHIVE_ERROR_PATH        37
+#define ARCHIVE_ERROR_THREAD      38
+#define ARCHIVE_ERROR_OPTION      39
+#define ARCHIVE_ERROR_CHECKSUM    40
+
+/* Opaque type representing an archive */
+typedef struct __archive archive;
+
+/* Allocate and return an archive
+   mode:    specify create/extract mode
+   type:    type of the blocks written by archive_create()
+   param:   parameter of the algorithm (dictionary or block size)
+ */
+archive* archive_new(uint8_t mode, uint8_t type, uint32_t param);
+
+/* Set an option of the archive (ARCHIVE_OPTION_FILTER appends the filter
+   kind << 8 | stride to the chain applied to the compressed blocks, 0
+   clears the chain; ARCHIVE_OPTION_ALPHABET takes the bits of the symbols
+   of lz78 blocks, LZ78_ALPHABET_BYTE or LZ78_ALPHABET_WIDE;
+   ARCHIVE_OPTION_RECORDS cuts the blocks after the given number of records,
+   i.e. lines, and indexes the records of each block, 0 disables it;
+   ARCHIVE_OPTION_CHECKSUM 0 drops the checksums of the blocks, which are
+   stored by default: the workers then read stored blocks only for the tail
+   which primes the next block)
+   Return:  one of defined archive-level return codes
+ */
+uint8_t archive_set(archive* a, uint8_t option, uint32_t value);
+
+/* Add a file or (recursively) a directory to the archive; in extract mode
+   select a member (file or directory) to extract instead of the whole archive
+   Return:  one of defined archive-level return codes
+ */
+uint8_t archive_add(archive* a, const char* path);
+
+/* Add the files and directories listed one per line in the given file
+   Return:  one of defined archive-level return codes
+ */
+uint8_t archive_add_list(archive* a, const char* list);
+
+/* Compress the added files in parallel writing the archive to fd_out
+   Return:  one of defined archive-level return codes
+ */
+uint8_t archive_create(archive* a, int fd_out);
+
+/* Extract in parallel the archive read from fd_in (which must be
+   seekable) into the directory dest, verifying the checksums of the
+   blocks extracted (stored ones included)
+   Return:  one of defined archive-level return codes
+ */
+uint8_t archive_extract(archive* a, int fd_in, const char* dest);
+
+/* Test in parallel the archive read from fd_in (which must be seekable)
+   without writing anything: the blocks of the selected members (all of
+   them by default) are decoded, or read if stored, and their checksums
+   verified
+   Return:  one of defined archive-level return codes
+ */
+uint8_t archive_test(archive* a, int fd_in);
+
+/* Write to fd_out the records (lines) numbered from first to last (counted
+   from 1) of the archive read from fd_in, which must have been created with
+   ARCHIVE_OPTION_RECORDS: only the blocks holding them are decompressed
+   Return:  one of defined archive-level return codes
+ */
+uint8_t archive_records(archive* a, int fd_in, uint64_t first, uint64_t last,
+                        int fd_out);
+
+/* Deallocate the archive */
+void archive_destroy(archive* a);
+
+#endif /* __ARCHIVE_H */
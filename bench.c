@@ -0,0 +1,497 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "pool.h"
+
+/* Size of the generated corpus */
+#define CORPUS_DEFAULT   (32 << 20)
+/* Number of files of the corpus */
+#define CORPUS_FILES     64
+/* Size of the buffers copied by each thread to measure the bandwidth */
+#define BW_BUFFER        (32 << 20)
+/* Number of copies of the buffers of each thread */
+#define BW_LOOPS         8
+
+/* Result of the runs with a given number of threads */
+struct __bench_run {
+    uint32_t threads;         /* Number of workers */
+    double create;            /* Seconds spent compressing */
+    double extract;           /* Seconds spent decompressing */
+    double bw;                /* memcpy bandwidth of as many threads (B/s) */
+    uint8_t identical;        /* Flag indicating the archive is identical */
+    uint8_t extracted;        /* Flag indicating the extraction is correct */
+};
+
+/* The opaque type of the result of the runs */
+typedef struct __bench_run bench_run;
+
+/* Thread measuring the memcpy bandwidth */
+struct __bw_thread {
+    pthread_t thread;         /* Thread copying the buffers */
+    pthread_barrier_t* start; /* Barrier releasing the copies */
+    char* src;                /* Buffer read */
+    char* dst;                /* Buffer written */
+};
+
+/* The opaque type of the thread measuring the bandwidth */
+typedef struct __bw_thread bw_thread;
+
+/* Words used to generate text-like data */
+static const char* words[] = {
+    "the", "of", "dictionary", "compression", "lz78", "block", "archive",
+    "thread", "worker", "{\"id\":", "\"name\":", "true", "false", "null",
+    "return", "uint32_t", "static", "void", "int", "char", "for", "while",
+    "if", "else", "\n", "\n    ", "; ", ", ", "(", ")", "0", "1", "4096"
+};
+
+/* Deterministic generator, so that the corpus is the same on every run */
+static uint32_t rnd_state = 2463534242u;
+
+static uint32_t rnd() {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+/* Fill a buffer with text-like data, with some incompressible runs */
+static void generate(char* buf, uint32_t n) {
+    uint32_t i = 0;
+    uint32_t j;
+    const char* w;
+    size_t len;
+
+    while (i < n) {
+        if (rnd() % 1024 == 0) {
+            for (j = 0; j < 512 && i < n; ++j)
+                buf[i++] = rnd();
+            continue;
+        }
+        w = words[rnd() % (sizeof(words) / sizeof(words[0]))];
+        len = strlen(w);
+        for (j = 0; j < len && i < n; ++j)
+            buf[i++] = w[j];
+        if (i < n)
+            buf[i++] = ' ';
+    }
+}
+
+/* Create the corpus into dir: files of random size, some of them larger
+   than a block */
+static int corpus_create(const char* dir, uint32_t size) {
+    char name[4096 + 16];
+    char* buf;
+    uint32_t i;
+    uint32_t n;
+    int fd;
+
+    buf = malloc(size);
+    if (buf == NULL)
+        return -1;
+
+    for (i = 0; i < CORPUS_FILES && size > 0; ++i) {
+        n = rnd() % (2 * size / CORPUS_FILES + 1);
+        n = (n > size || i == CORPUS_FILES - 1) ? size : n;
+        size -= n;
+
+        generate(buf, n);
+        if (snprintf(name, sizeof(name), "%s/d%u", dir, i % 4) >=
+                (int) sizeof(name)) {
+            free(buf);
+            return -1;
+        }
+        mkdir(name, 0755);
+        sprintf(name + strlen(name), "/f%03u", i);
+        fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1 || write(fd, buf, n) != (ssize_t) n) {
+            free(buf);
+            return -1;
+        }
+        close(fd);
+    }
+    free(buf);
+    return 0;
+}
+
+static int same_file(const char* x, const char* y);
+
+/* Root of the tree being compared with the corpus */
+static const char* cmp_root;
+/* Number of files of the tree differing from the corpus */
+static uint32_t cmp_errors;
+
+static int compare_entry(const char* path, const struct stat* st, int flag,
+                         struct FTW* ftw) {
+    char name[8192];
+
+    if (flag != FTW_F)
+        return 0;
+    /* Archives store the paths without the leading "/" */
+    snprintf(name, sizeof(name), "%s/%s", cmp_root, path + 1);
+    if (same_file(path, name) != 0)
+        ++cmp_errors;
+    return 0;
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag,
+                        struct FTW* ftw) {
+    return remove(path);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Compare two files
+   Return:  0 if they are identical, -1 otherwise
+ */
+static int same_file(const char* x, const char* y) {
+    char bx[65536];
+    char by[65536];
+    ssize_t nx, ny;
+    int fx = open(x, O_RDONLY);
+    int fy = open(y, O_RDONLY);
+    int ret = -1;
+
+    if (fx != -1 && fy != -1) {
+        for (;;) {
+            nx = read(fx, bx, sizeof(bx));
+            ny = read(fy, by, sizeof(by));
+            if (nx != ny || nx < 0 || memcmp(bx, by, nx) != 0)
+                break;
+            if (nx == 0) {
+                ret = 0;
+                break;
+            }
+        }
+    }
+    if (fx != -1)
+        close(fx);
+    if (fy != -1)
+        close(fy);
+    return ret;
+}
+
+/* Create an archive of the corpus
+   Return:  elapsed seconds, negative on failure
+ */
+static double run_create(const char* corpus, const char* out, uint8_t type,
+                         uint32_t threads, uint32_t b_size, uint32_t prime,
+                         uint8_t solid) {
+    archive* a;
+    double t;
+    int fd;
+    uint8_t ret;
+
+    a = archive_new(ARCHIVE_MODE_CREATE, type, 0);
+    if (a == NULL)
+        return -1;
+    archive_set(a, ARCHIVE_OPTION_THREADS, threads);
+    archive_set(a, ARCHIVE_OPTION_BLOCK_SIZE, b_size);
+    archive_set(a, ARCHIVE_OPTION_PRIME, prime);
+    archive_set(a, ARCHIVE_OPTION_SOLID, solid);
+
+    fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || archive_add(a, corpus) != ARCHIVE_SUCCESS) {
+        archive_destroy(a);
+        return -1;
+    }
+
+    t = now();
+    ret = archive_create(a, fd);
+    t = now() - t;
+
+    close(fd);
+    archive_destroy(a);
+    return (ret == ARCHIVE_SUCCESS) ? t : -1;
+}
+
+/* Extract an archive into dest
+   Return:  elapsed seconds, negative on failure
+ */
+static double run_extract(const char* in, const char* dest, uint32_t threads) {
+    archive* a;
+    double t;
+    int fd;
+    uint8_t ret;
+
+    a = archive_new(ARCHIVE_MODE_EXTRACT, ARCHIVE_BLOCK_LZ78, 0);
+    fd = open(in, O_RDONLY);
+    if (a == NULL || fd == -1) {
+        archive_destroy(a);
+        return -1;
+    }
+    archive_set(a, ARCHIVE_OPTION_THREADS, threads);
+
+    t = now();
+    ret = archive_extract(a, fd, dest);
+    t = now() - t;
+
+    close(fd);
+    archive_destroy(a);
+    return (ret == ARCHIVE_SUCCESS) ? t : -1;
+}
+
+static void* bw_copy(void* arg) {
+    bw_thread* b = (bw_thread*) arg;
+    uint32_t i;
+
+    pthread_barrier_wait(b->start);
+    for (i = 0; i < BW_LOOPS; ++i) {
+        memcpy(b->dst, b->src, BW_BUFFER);
+        /* Keep the copies from being merged */
+        b->src[i] = b->dst[BW_BUFFER - 1 - i];
+    }
+    return NULL;
+}
+
+/* Measure the memcpy bandwidth (bytes read plus written per second) of the
+   given number of threads copying at the same time
+   Return:  the bandwidth, 0 on failure
+ */
+static double bw_measure(uint32_t threads) {
+    pthread_barrier_t start;
+    bw_thread* b;
+    uint32_t i;
+    uint32_t n;
+    double t;
+
+    b = calloc(threads, sizeof(bw_thread));
+    if (b == NULL)
+        return 0;
+
+    for (n = 0; n < threads; ++n) {
+        b[n].src = malloc(BW_BUFFER);
+        b[n].dst = malloc(BW_BUFFER);
+        if (b[n].src == NULL || b[n].dst == NULL)
+            break;
+        memset(b[n].src, n, BW_BUFFER);
+        memset(b[n].dst, 0, BW_BUFFER);
+    }
+
+    t = 0;
+    if (n == threads) {
+        pthread_barrier_init(&start, NULL, threads + 1);
+        for (i = 0; i < threads; ++i) {
+            b[i].start = &start;
+            pthread_create(&b[i].thread, NULL, bw_copy, &b[i]);
+        }
+        pthread_barrier_wait(&start);
+        t = now();
+        for (i = 0; i < threads; ++i)
+            pthread_join(b[i].thread, NULL);
+        t = now() - t;
+        pthread_barrier_destroy(&start);
+    }
+
+    for (i = 0; i < threads; ++i) {
+        free(b[i].src);
+        free(b[i].dst);
+    }
+    free(b);
+    return (t > 0) ? 2.0 * BW_BUFFER * BW_LOOPS * threads / t : 0;
+}
+
+/* Print the scaling of one direction
+   bytes:   data moved through memory by a run (input plus output)
+ */
+static void report(const char* title, bench_run* runs, uint32_t n_runs,
+                   uint32_t size, uint64_t bytes, int extract) {
+    double t, t1;
+    uint32_t i;
+
+    printf("\n%s\n", title);
+    printf("%8s %9s %9s %8s %6s %10s %6s %10s\n", "threads", "seconds",
+           "MB/s", "speedup", "eff", "MB/s/thr", "bw%", "output");
+
+    t1 = extract ? runs[0].extract : runs[0].create;
+    for (i = 0; i < n_runs; ++i) {
+        t = extract ? runs[i].extract : runs[i].create;
+        printf("%8u %9.3f %9.1f %8.2f %5.0f%% %10.1f %5.1f%% %10s\n",
+               runs[i].threads, t, size / t / 1e6, t1 / t,
+               100 * t1 / t / runs[i].threads,
+               size / t / 1e6 / runs[i].threads,
+               runs[i].bw > 0 ? 100 * bytes / t / runs[i].bw : 0,
+               extract ? (runs[i].extracted ? "correct" : "WRONG") :
+               (i == 0 ? "reference" :
+                runs[i].identical ? "identical" : "DIFFERENT"));
+    }
+}
+
+static void help(char* argv[]) {
+    fprintf(stderr,
+            "Usage: %s [Options]\n\n"
+            "Checks that archives are byte-identical for every number of\n"
+            "workers and measures the scaling of compression and extraction:\n"
+            "speedup and efficiency against one thread, MB/s per thread and\n"
+            "share (bw%%) of the memcpy bandwidth of as many threads used by\n"
+            "the data streamed in and out.\n\n"
+            "Options:\n"
+            "-h          show this help\n"
+            "-t type     sets compression algorithm (lz78, lz77)\n"
+            "-s size     sets the size of the generated corpus (M)\n"
+            "-j n        sets the maximum number of workers\n"
+            "-B size     sets the size of the blocks (K)\n"
+            "-p size     sets the priming of the blocks (K)\n"
+            "-S          sets solid mode\n"
+            "",
+            argv[0]);
+}
+
+int main(int argc, char* argv[]) {
+    char dir[] = "/tmp/lz78-bench-XXXXXX";
+    char corpus[4096];
+    char ref[4096];
+    char out[4096];
+    char dest[4096];
+    bench_run runs[64];
+    uint32_t n_runs = 0;
+    struct stat st;
+    uint8_t type = ARCHIVE_BLOCK_LZ78;
+    uint32_t size = CORPUS_DEFAULT;
+    uint32_t max_threads = pool_cpus();
+    uint32_t b_size = ARCHIVE_BLOCK_MIN * 4;
+    uint32_t prime = 0;
+    uint8_t solid = 0;
+    uint32_t threads;
+    bench_run* r;
+    int failed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:s:j:B:p:Sh")) != -1) {
+        switch (opt) {
+            case 't':
+                if (strcmp(optarg, "lz78") == 0)
+                    type = ARCHIVE_BLOCK_LZ78;
+                else if (strcmp(optarg, "lz77") == 0)
+                    type = ARCHIVE_BLOCK_LZ77;
+                else {
+                    help(argv);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 's':
+                size = atoi(optarg) << 20;
+                break;
+
+            case 'j':
+                max_threads = atoi(optarg);
+                break;
+
+            case 'B':
+                b_size = atoi(optarg) << 10;
+                break;
+
+            case 'p':
+                prime = atoi(optarg) << 10;
+                break;
+
+            case 'S':
+                solid = 1;
+                break;
+
+            case 'h':
+            default:
+                help(argv);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (max_threads == 0 || size == 0) {
+        help(argv);
+        exit(EXIT_FAILURE);
+    }
+
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(corpus, sizeof(corpus), "%s/corpus", dir);
+    snprintf(ref, sizeof(ref), "%s/ref.lza", dir);
+    snprintf(out, sizeof(out), "%s/out.lza", dir);
+
+    if (mkdir(corpus, 0755) == -1 || corpus_create(corpus, size) == -1) {
+        fprintf(stderr, "Unable to create the corpus\n");
+        nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("corpus %u MB, blocks %u KB, prime %u KB%s\n", size >> 20,
+           b_size >> 10, prime >> 10, solid ? ", solid" : "");
+
+    for (threads = 1; threads <= max_threads && n_runs < 64; ++threads) {
+        /* 1, 2, 4, ... and the maximum */
+        if (threads > 2 && (threads & (threads - 1)) != 0 &&
+                threads != max_threads)
+            continue;
+
+        r = &runs[n_runs];
+        r->threads = threads;
+        r->create = run_create(corpus, threads == 1 ? ref : out, type,
+                               threads, b_size, prime, solid);
+        if (r->create < 0) {
+            fprintf(stderr, "Compression with %u threads failed\n", threads);
+            failed = 1;
+            break;
+        }
+        r->identical = (threads == 1 || same_file(ref, out) == 0);
+
+        snprintf(dest, sizeof(dest), "%s/x%u", dir, threads);
+        r->extract = run_extract(ref, dest, threads);
+        if (r->extract < 0) {
+            fprintf(stderr, "Extraction with %u threads failed\n", threads);
+            failed = 1;
+            break;
+        }
+        cmp_root = dest;
+        cmp_errors = 0;
+        nftw(corpus, compare_entry, 16, FTW_PHYS);
+        r->extracted = (cmp_errors == 0);
+        nftw(dest, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+        r->bw = bw_measure(threads);
+        failed |= !r->identical || !r->extracted;
+        ++n_runs;
+    }
+
+    if (n_runs > 0 && stat(ref, &st) == 0) {
+        printf("ratio %.3f\n", (double) st.st_size / size);
+        report("compression", runs, n_runs, size, size + st.st_size, 0);
+        report("extraction", runs, n_runs, size, size + st.st_size, 1);
+    }
+
+    nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -128,9 +128,9 @@ int bit_read(bit_file* bfp, char* buff_out, UINTMAX_T n_bits, uint8_t ofs) {
 
         readptr = (uint8_t*)&(bfp->buff) + w_start / 8;
 
-        if (aligned && w_len > 7 && n_bits >= w_len) {
+        if (aligned && w_len > 7 && n_bits > 7) {
             /* Optimization: due to alignment we can use memcpy */
-            buff_ready_bytes = w_len / 8;
+            buff_ready_bytes = ((n_bits < w_len) ? n_bits : w_len) / 8;
             memcpy(base, readptr, buff_ready_bytes);
             base += buff_ready_bytes;
 
@@ -203,9 +203,9 @@ int bit_write(bit_file* bfp, const char* buff_in, UINTMAX_T n_bits, uint8_t ofs)
     while (n_bits > 0) {
         writeptr = (uint8_t*)&(bfp->buff) + pos / 8;
 
-        if (aligned && buff_free_bits > 7 && n_bits >= buff_free_bits) {
+        if (aligned && buff_free_bits > 7 && n_bits > 7) {
             /* Optimization: due to alignment we can use memcpy */
-            buff_free_bytes = buff_free_bits / 8;
+            buff_free_bytes = ((n_bits < buff_free_bits) ? n_bits : buff_free_bits) / 8;
             memcpy(writeptr, base, buff_free_bytes);
             base += buff_free_bytes;
             bits_written = buff_free_bytes * 8;
@@ -224,6 +224,12 @@ int bit_write(bit_file* bfp, const char* buff_in, UINTMAX_T n_bits, uint8_t ofs)
                 *writeptr |= (1 << pos % 8);
             }
 
+            ++pos;
+            ++(bfp->w_len);
+            --(n_bits);
+            --buff_free_bits;
+            ++ret;
+
             if (mask == 0x80) {
                 mask = 1;
                 ++base;
@@ -231,12 +237,6 @@ int bit_write(bit_file* bfp, const char* buff_in, UINTMAX_T n_bits, uint8_t ofs)
             } else {
                 mask <<= 1;
             }
-
-            ++pos;
-            ++(bfp->w_len);
-            --(n_bits);
-            --buff_free_bits;
-            ++ret;
         }
 
         /* Flush if needed */
@@ -282,8 +282,35 @@ int bit_flush(bit_file* bfp) {
         count -= n;
     }
 
-    bfp->w_start = (bfp->w_start + written * 8) % bfp->buff_size;
     bfp->w_len -= written * 8;
+    /* Writes continue from the start of the buffer: the data a partial
+       write has left is moved there */
+    if (written > 0 && bfp->w_len > 0)
+        memmove(bfp->buff, base, (bfp->w_len + 7) / 8);
+    bfp->w_start = 0;
+    return 0;
+}
+
+UINTMAX_T bit_pending(bit_file* bfp) {
+    return (bfp == NULL) ? 0 : bfp->w_len;
+}
+
+int bit_align(bit_file* bfp) {
+    UINTMAX_T pad;
+
+    if (bfp == NULL)
+        return -1;
+
+    if (bfp->mode == ACCESS_READ) {
+        pad = (8 - bfp->w_start % 8) % 8;
+        if (pad > bfp->w_len)
+            return -1;
+        bfp->w_start = (bfp->w_start + pad) % bfp->buff_size;
+        bfp->w_len -= pad;
+    } else {
+        pad = (8 - bfp->w_len % 8) % 8;
+        bfp->w_len += pad;
+    }
     return 0;
 }
 
@@ -47,6 +47,12 @@ int bit_write(bit_file* bf, const char* base, UINTMAX_T n_bits, uint8_t ofs);
 /* Effectively swap out the buffer into memory */
 int bit_flush(bit_file* bf);
 
+/* Returns the bits buffered and not yet read (reading) or flushed (writing) */
+UINTMAX_T bit_pending(bit_file* bf);
+
+/* Skips (reading) or pads (writing) the bits up to the next byte */
+int bit_align(bit_file* bf);
+
 /* Relases the resources allocated by the bit_file */
 int bit_close(bit_file* bf);
 
@@ -0,0 +1,152 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+/* Names of the filters, indexed by kind */
+static const char* filter_names[] = {NULL, "delta", "transpose"};
+
+int filter_parse(const char* spec, filter* chain) {
+    const char* p = spec;
+    char* end;
+    long stride;
+    size_t len;
+    int n = 0;
+    uint8_t k;
+
+    while (*p) {
+        if (n == FILTER_CHAIN_MAX)
+            return -1;
+
+        for (k = FILTER_DELTA; k <= FILTER_TRANSPOSE; ++k) {
+            len = strlen(filter_names[k]);
+            if (strncmp(p, filter_names[k], len) == 0 && p[len] == ':')
+                break;
+        }
+        if (k > FILTER_TRANSPOSE)
+            return -1;
+
+        p += len + 1;
+        stride = strtol(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0') || stride < 1 ||
+                stride > 255)
+            return -1;
+
+        chain[n].kind = k;
+        chain[n].stride = stride;
+        if (filter_check(&chain[n]) == -1)
+            return -1;
+        ++n;
+
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return n;
+}
+
+int filter_check(const filter* f) {
+    switch (f->kind) {
+        case FILTER_DELTA:
+            return (f->stride >= 1) ? 0 : -1;
+        case FILTER_TRANSPOSE:
+            return (f->stride >= 2) ? 0 : -1;
+    }
+    return -1;
+}
+
+/* Replace each byte with its difference from the byte stride positions
+   before (the first stride bytes are kept) */
+static void delta_encode(uint8_t* buf, uint32_t len, uint32_t stride,
+                         uint8_t* tmp) {
+    uint32_t i;
+
+    if (len <= stride)
+        return;
+    for (i = stride; i < len; ++i)
+        tmp[i] = buf[i] - buf[i - stride];
+    memcpy(buf + stride, tmp + stride, len - stride);
+}
+
+/* Rebuild the bytes a stride at a time: the inner loop only depends on the
+   previous stride, so it is vectorized for long strides */
+static void delta_decode(uint8_t* buf, uint32_t len, uint32_t stride) {
+    uint32_t i, j, n;
+
+    for (i = stride; i < len; i += stride) {
+        n = (len - i < stride) ? len - i : stride;
+        for (j = 0; j < n; ++j)
+            buf[i + j] += buf[i + j - stride];
+    }
+}
+
+/* Group the k-th bytes of all the records of stride bytes together (the
+   bytes after the last whole record are kept) */
+static void transpose_encode(uint8_t* buf, uint32_t len, uint32_t stride,
+                             uint8_t* tmp) {
+    uint32_t count = len / stride;
+    uint32_t i, j;
+
+    if (count < 2)
+        return;
+    for (j = 0; j < stride; ++j)
+        for (i = 0; i < count; ++i)
+            tmp[j * count + i] = buf[i * stride + j];
+    memcpy(buf, tmp, count * stride);
+}
+
+static void transpose_decode(uint8_t* buf, uint32_t len, uint32_t stride,
+                             uint8_t* tmp) {
+    uint32_t count = len / stride;
+    uint32_t i, j;
+
+    if (count < 2)
+        return;
+    for (i = 0; i < count; ++i)
+        for (j = 0; j < stride; ++j)
+            tmp[i * stride + j] = buf[j * count + i];
+    memcpy(buf, tmp, count * stride);
+}
+
+void filter_encode(const filter* chain, int n, char* buf, uint32_t len,
+                   char* tmp) {
+    int i;
+
+    for (i = 0; i < n; ++i) {
+        if (chain[i].kind == FILTER_DELTA)
+            delta_encode((uint8_t*) buf, len, chain[i].stride, (uint8_t*) tmp);
+        else
+            transpose_encode((uint8_t*) buf, len, chain[i].stride,
+                             (uint8_t*) tmp);
+    }
+}
+
+void filter_decode(const filter* chain, int n, char* buf, uint32_t len,
+                   char* tmp) {
+    int i;
+
+    for (i = n - 1; i >= 0; --i) {
+        if (chain[i].kind == FILTER_DELTA)
+            delta_decode((uint8_t*) buf, len, chain[i].stride);
+        else
+            transpose_decode((uint8_t*) buf, len, chain[i].stride,
+                             (uint8_t*) tmp);
+    }
+}
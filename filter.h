@@ -0,0 +1,65 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FILTER_H
+#define __FILTER_H
+
+#include <stdint.h>
+
+/* Kinds of filters */
+#define FILTER_NONE       0
+#define FILTER_DELTA      1
+#define FILTER_TRANSPOSE  2
+
+/* Maximum number of filters of a chain */
+#define FILTER_CHAIN_MAX  4
+
+/* Filter reshaping the data before compression to make it more repetitive
+   (e.g. numeric arrays and fixed-width records) */
+struct __filter {
+    uint8_t kind;             /* Kind of the filter */
+    uint8_t stride;           /* Distance (delta) or record size (transpose) */
+};
+
+/* The type representing a filter */
+typedef struct __filter filter;
+
+/* Parse a comma separated chain of filters ("delta:N", "transpose:N")
+   Return:  the number of filters, -1 on syntax error
+ */
+int filter_parse(const char* spec, filter* chain);
+
+/* Check that a filter is valid
+   Return:  0 if valid, -1 otherwise
+ */
+int filter_check(const filter* f);
+
+/* Apply the n filters of the chain in order to buf
+   tmp:     scratch buffer of at least len bytes
+ */
+void filter_encode(const filter* chain, int n, char* buf, uint32_t len,
+                   char* tmp);
+
+/* Invert the n filters of the chain (in reverse order) on buf
+   tmp:     scratch buffer of at least len bytes
+ */
+void filter_decode(const filter* chain, int n, char* buf, uint32_t len,
+                   char* tmp);
+
+#endif /* __FILTER_H */
@@ -0,0 +1,545 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "lz77.h"
+
+/* Minimum length of a match */
+#define MIN_MATCH        4
+/* Maximum distance of a match (16 bit offsets) */
+#define MAX_DISTANCE     65535
+/* The last bytes of a block are always emitted as literals */
+#define LAST_LITERALS    5
+/* A match can't start inside the last bytes of a block */
+#define MF_LIMIT         12
+/* Number of bits of the match finder hash table */
+#define HASH_LOG         14
+/* Number of misses before the match finder starts to skip input */
+#define SKIP_TRIGGER     6
+
+/* Flag of the block header marking a block stored without compression */
+#define BLOCK_STORED     0x80000000
+/* Size of the block header (raw length + compressed length) */
+#define BLOCK_HEADER     8
+
+/* Limits b_size inside [LZ77_BLOCK_MIN, LZ77_BLOCK_MAX] */
+#define BLOCK_LIMIT(x) (((x) < LZ77_BLOCK_MIN) ? LZ77_BLOCK_MIN : (((x) > LZ77_BLOCK_MAX) ? LZ77_BLOCK_MAX : (x)))
+
+/* Worst case size of a compressed block */
+#define BLOCK_BOUND(x) LZ77_BOUND(x)
+
+/* lz77 instance descriptor */
+struct __lz77_instance {
+    uint8_t mode;             /* Discriminate compression operations */
+    uint32_t b_size;          /* Size of the blocks */
+    uint32_t in_len;          /* Number of valid bytes contained in in_buf */
+    uint32_t in_size;         /* Size of in_buf */
+    uint32_t out_size;        /* Size of out_buf */
+    uint32_t* table;          /* Hash table of the match finder */
+    uint8_t* in_buf;          /* Buffer holding the current input block */
+    uint8_t* out_buf;         /* Buffer holding the current output block */
+};
+
+/* Unaligned little endian accessors */
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static inline void put32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static inline uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Return the number of equal bytes starting from p and q */
+static inline uint32_t match_count(const uint8_t* p, const uint8_t* q,
+                                   const uint8_t* limit) {
+    const uint8_t* start = p;
+    uint64_t diff;
+
+    while (p + 8 <= limit) {
+        diff = read64(p) ^ read64(q);
+        if (diff)
+            return p - start + (__builtin_ctzll(diff) >> 3);
+        p += 8;
+        q += 8;
+    }
+    while (p < limit && *p == *q) {
+        ++p;
+        ++q;
+    }
+    return p - start;
+}
+
+/* Write a length using the 4 bits of the token plus 255-valued extensions */
+static inline uint8_t* put_length(uint8_t* op, uint32_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+/* Emit a sequence made of literals followed by an optional match */
+static inline uint8_t* put_sequence(uint8_t* op, const uint8_t* anchor,
+                                    uint32_t lit, uint32_t offset,
+                                    uint32_t len) {
+    uint8_t* token = op++;
+
+    if (lit >= 15) {
+        *token = 15 << 4;
+        op = put_length(op, lit - 15);
+    } else {
+        *token = lit << 4;
+    }
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    if (offset == 0)
+        return op;
+
+    *op++ = offset;
+    *op++ = offset >> 8;
+    len -= MIN_MATCH;
+    if (len >= 15) {
+        *token |= 15;
+        op = put_length(op, len - 15);
+    } else {
+        *token |= len;
+    }
+    return op;
+}
+
+/* Compress a block using a single-probe hash table (no chains)
+   Return:  the size of the compressed block
+ */
+static uint32_t compress_block(uint32_t* table, const uint8_t* in,
+                               uint32_t n, uint8_t* out) {
+    const uint8_t* ip = in;
+    const uint8_t* anchor = in;
+    const uint8_t* iend = in + n;
+    const uint8_t* mflimit = iend - MF_LIMIT;
+    const uint8_t* matchlimit = iend - LAST_LITERALS;
+    const uint8_t* ref;
+    uint8_t* op = out;
+    uint32_t h;
+    uint32_t len;
+
+    if (n > MF_LIMIT) {
+        memset(table, 0, sizeof(uint32_t) << HASH_LOG);
+
+        while (ip < mflimit) {
+            h = hash32(read32(ip));
+            ref = in + table[h];
+            table[h] = ip - in;
+
+            if (ref >= ip || ip - ref > MAX_DISTANCE ||
+                    read32(ref) != read32(ip)) {
+                /* Miss: step faster on data which doesn't compress */
+                ip += 1 + ((ip - anchor) >> SKIP_TRIGGER);
+                continue;
+            }
+
+            /* Extend the match backward */
+            while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+
+            len = MIN_MATCH + match_count(ip + MIN_MATCH, ref + MIN_MATCH,
+                                          matchlimit);
+            op = put_sequence(op, anchor, ip - anchor, ip - ref, len);
+            ip += len;
+            anchor = ip;
+
+            /* Reference the end of the match to help the next search */
+            if (ip < mflimit)
+                table[hash32(read32(ip - 2))] = ip - 2 - in;
+        }
+    }
+
+    /* Trailing literals */
+    return put_sequence(op, anchor, iend - anchor, 0, 0) - out;
+}
+
+/* Decompress a block checking every access against the buffer limits
+   Return:
+     0   success
+    -1   corrupted block
+ */
+static int decompress_block(const uint8_t* in, uint32_t n_in, uint8_t* out,
+                            uint32_t n_out) {
+    const uint8_t* ip = in;
+    const uint8_t* iend = in + n_in;
+    const uint8_t* match;
+    uint8_t* op = out;
+    uint8_t* oend = out + n_out;
+    uint8_t* cpy;
+    uint32_t token;
+    uint32_t len;
+    uint32_t offset;
+    uint8_t s;
+
+    while (ip < iend) {
+        token = *ip++;
+
+        /* Literals */
+        len = token >> 4;
+        if (len == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                s = *ip++;
+                len += s;
+            } while (s == 255);
+        }
+        if (len > (uint32_t)(iend - ip) || len > (uint32_t)(oend - op))
+            return -1;
+        if (len <= 16 && iend - ip >= 16 && oend - op >= 16)
+            memcpy(op, ip, 16);
+        else
+            memcpy(op, ip, len);
+        op += len;
+        ip += len;
+
+        /* The last sequence has no match */
+        if (ip == iend)
+            break;
+
+        /* Match */
+        if (iend - ip < 2)
+            return -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - out))
+            return -1;
+
+        len = token & 15;
+        if (len == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                s = *ip++;
+                len += s;
+            } while (s == 255);
+        }
+        len += MIN_MATCH;
+        if (len > (uint32_t)(oend - op))
+            return -1;
+
+        match = op - offset;
+        cpy = op + len;
+        if (offset >= 8 && oend - cpy >= 8) {
+            /* Wild copy: may write up to 7 bytes past cpy */
+            do {
+                memcpy(op, match, 8);
+                op += 8;
+                match += 8;
+            } while (op < cpy);
+        } else {
+            while (op < cpy)
+                *op++ = *match++;
+        }
+        op = cpy;
+    }
+
+    return (op == oend) ? 0 : -1;
+}
+
+/* Grow a buffer to the given size
+   Return:
+     0   success
+    -1   allocation failure
+ */
+static int buffer_reserve(uint8_t** buf, uint32_t* size, uint32_t n) {
+    uint8_t* p;
+
+    if (*size >= n)
+        return 0;
+
+    p = realloc(*buf, n);
+    if (p == NULL)
+        return -1;
+
+    *buf = p;
+    *size = n;
+    return 0;
+}
+
+/* Write the given buffer entirely into the bit_file
+   Return:  one of defined lz77-level return codes
+ */
+static uint8_t block_write(bit_file* out, const uint8_t* buf, uint32_t n) {
+    int bits;
+
+    if (n == 0)
+        return LZ77_SUCCESS;
+
+    bits = bit_write(out, (const char*) buf, n * 8, 0);
+    if (bits == -1)
+        return LZ77_ERROR_WRITE;
+    if (bits != n * 8)
+        return LZ77_ERROR_EAGAIN;
+    return LZ77_SUCCESS;
+}
+
+/* Read exactly n bytes from the bit_file
+   Return:  one of defined lz77-level return codes
+ */
+static uint8_t block_read(bit_file* in, uint8_t* buf, uint32_t n) {
+    int bits;
+
+    if (n == 0)
+        return LZ77_SUCCESS;
+
+    bits = bit_read(in, (char*) buf, n * 8, 0);
+    if (bits == -1)
+        return LZ77_ERROR_READ;
+    if (bits != n * 8)
+        return LZ77_ERROR_DECOMPRESS;
+    return LZ77_SUCCESS;
+}
+
+lz77_instance* lz77_new(uint8_t cmode, uint32_t bsize) {
+    lz77_instance* i;
+
+    if (cmode != LZ77_MODE_COMPRESS && cmode != LZ77_MODE_DECOMPRESS)
+        return NULL;
+
+    i = calloc(1, sizeof(lz77_instance));
+    if (i == NULL)
+        return NULL;
+
+    i->mode = cmode;
+    bsize = (bsize == 0) ? LZ77_BLOCK_DEFAULT : bsize;
+    i->b_size = BLOCK_LIMIT(bsize);
+
+    /* The decompressor sizes its buffers from the block headers */
+    if (cmode == LZ77_MODE_DECOMPRESS)
+        return i;
+
+    i->table = malloc(sizeof(uint32_t) << HASH_LOG);
+    i->in_buf = malloc(i->b_size);
+    i->out_buf = malloc(BLOCK_BOUND(i->b_size));
+    if (i->table == NULL || i->in_buf == NULL || i->out_buf == NULL) {
+        lz77_destroy(i);
+        return NULL;
+    }
+    i->in_size = i->b_size;
+    i->out_size = BLOCK_BOUND(i->b_size);
+    return i;
+}
+
+uint8_t lz77_compress(lz77_instance* lz77, int fd_in, int fd_out) {
+    bit_file* out;
+    uint8_t header[BLOCK_HEADER];
+    uint32_t n;
+    uint8_t ret;
+    int c;
+
+    if (lz77 == NULL)
+        return LZ77_ERROR_INITIALIZATION;
+
+    if (lz77->mode != LZ77_MODE_COMPRESS)
+        return LZ77_ERROR_MODE;
+
+    out = bit_open(fd_out, ACCESS_WRITE, B_SIZE_DEFAULT);
+    if (out == NULL)
+        return LZ77_ERROR_WRITE;
+
+    for (;;) {
+        /* Fill the current block */
+        while (lz77->in_len < lz77->b_size) {
+            c = read(fd_in, lz77->in_buf + lz77->in_len,
+                     lz77->b_size - lz77->in_len);
+            if (c == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN) {
+                    errno = 0;
+                    return LZ77_ERROR_EAGAIN;
+                }
+                return LZ77_ERROR_READ;
+            } else if (c == 0) {
+                break;
+            }
+            lz77->in_len += c;
+        }
+
+        if (lz77->in_len == 0)
+            break;
+
+        n = compress_block(lz77->table, lz77->in_buf, lz77->in_len,
+                           lz77->out_buf);
+
+        put32(header, lz77->in_len);
+        if (n >= lz77->in_len) {
+            /* Incompressible data: store the block as is */
+            put32(header + 4, lz77->in_len | BLOCK_STORED);
+            ret = block_write(out, header, BLOCK_HEADER);
+            if (ret == LZ77_SUCCESS)
+                ret = block_write(out, lz77->in_buf, lz77->in_len);
+        } else {
+            put32(header + 4, n);
+            ret = block_write(out, header, BLOCK_HEADER);
+            if (ret == LZ77_SUCCESS)
+                ret = block_write(out, lz77->out_buf, n);
+        }
+        if (ret != LZ77_SUCCESS)
+            return ret;
+
+        lz77->in_len = 0;
+    }
+
+    /* End of stream marker */
+    put32(header, 0);
+    ret = block_write(out, header, 4);
+    if (ret != LZ77_SUCCESS)
+        return ret;
+
+    bit_close(out);
+    return LZ77_SUCCESS;
+}
+
+uint8_t lz77_decompress(lz77_instance* lz77, int fd_in, int fd_out) {
+    bit_file* in;
+    bit_file* out;
+    uint8_t header[BLOCK_HEADER];
+    uint32_t raw_len;
+    uint32_t comp_len;
+    uint8_t ret;
+
+    if (lz77 == NULL)
+        return LZ77_ERROR_INITIALIZATION;
+
+    if (lz77->mode != LZ77_MODE_DECOMPRESS)
+        return LZ77_ERROR_MODE;
+
+    in = bit_open(fd_in, ACCESS_READ, B_SIZE_DEFAULT);
+    if (in == NULL)
+        return LZ77_ERROR_READ;
+
+    out = bit_open(fd_out, ACCESS_WRITE, B_SIZE_DEFAULT);
+    if (out == NULL)
+        return LZ77_ERROR_WRITE;
+
+    for (;;) {
+        ret = block_read(in, header, 4);
+        if (ret != LZ77_SUCCESS)
+            return ret;
+
+        raw_len = get32(header);
+        if (raw_len == 0)
+            break;
+
+        ret = block_read(in, header + 4, 4);
+        if (ret != LZ77_SUCCESS)
+            return ret;
+
+        comp_len = get32(header + 4);
+        if (raw_len > LZ77_BLOCK_MAX)
+            return LZ77_ERROR_DECOMPRESS;
+
+        if (comp_len & BLOCK_STORED) {
+            if ((comp_len & ~BLOCK_STORED) != raw_len)
+                return LZ77_ERROR_DECOMPRESS;
+            if (buffer_reserve(&lz77->out_buf, &lz77->out_size, raw_len))
+                return LZ77_ERROR_MEMORY;
+            ret = block_read(in, lz77->out_buf, raw_len);
+        } else {
+            if (comp_len > BLOCK_BOUND(raw_len))
+                return LZ77_ERROR_DECOMPRESS;
+            if (buffer_reserve(&lz77->in_buf, &lz77->in_size, comp_len) ||
+                    buffer_reserve(&lz77->out_buf, &lz77->out_size, raw_len))
+                return LZ77_ERROR_MEMORY;
+            ret = block_read(in, lz77->in_buf, comp_len);
+            if (ret == LZ77_SUCCESS &&
+                    decompress_block(lz77->in_buf, comp_len,
+                                     lz77->out_buf, raw_len) != 0)
+                ret = LZ77_ERROR_DECOMPRESS;
+        }
+        if (ret != LZ77_SUCCESS)
+            return ret;
+
+        ret = block_write(out, lz77->out_buf, raw_len);
+        if (ret != LZ77_SUCCESS)
+            return ret;
+    }
+
+    bit_close(out);
+    return LZ77_SUCCESS;
+}
+
+uint8_t lz77_compress_mem(lz77_instance* lz77, const char* in, uint32_t n_in,
+                          char* out, uint32_t* n_out) {
+    if (lz77 == NULL)
+        return LZ77_ERROR_INITIALIZATION;
+
+    if (lz77->mode != LZ77_MODE_COMPRESS)
+        return LZ77_ERROR_MODE;
+
+    *n_out = compress_block(lz77->table, (const uint8_t*) in, n_in,
+                            (uint8_t*) out);
+    return LZ77_SUCCESS;
+}
+
+uint8_t lz77_decompress_mem(lz77_instance* lz77, const char* in, uint32_t n_in,
+                            char* out, uint32_t n_out) {
+    if (lz77 == NULL)
+        return LZ77_ERROR_INITIALIZATION;
+
+    if (lz77->mode != LZ77_MODE_DECOMPRESS)
+        return LZ77_ERROR_MODE;
+
+    if (decompress_block((const uint8_t*) in, n_in, (uint8_t*) out, n_out))
+        return LZ77_ERROR_DECOMPRESS;
+    return LZ77_SUCCESS;
+}
+
+void lz77_destroy(lz77_instance* lz77) {
+    if (lz77 != NULL) {
+        free(lz77->table);
+        free(lz77->in_buf);
+        free(lz77->out_buf);
+        free(lz77);
+    }
+}
@@ -0,0 +1,87 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LZ77_H
+#define __LZ77_H
+
+#include "bitio.h"
+
+/* Modes of compression */
+#define LZ77_MODE_COMPRESS        0
+#define LZ77_MODE_DECOMPRESS      1
+
+/* List of lz77-level return codes */
+#define LZ77_SUCCESS              10
+#define LZ77_ERROR_MEMORY         11
+#define LZ77_ERROR_READ           12
+#define LZ77_ERROR_WRITE          13
+#define LZ77_ERROR_EAGAIN         14
+#define LZ77_ERROR_COMPRESS       15
+#define LZ77_ERROR_DECOMPRESS     16
+#define LZ77_ERROR_INITIALIZATION 17
+#define LZ77_ERROR_MODE           18
+
+/* Size of the independent blocks the stream is split into */
+#define LZ77_BLOCK_MIN            65536
+#define LZ77_BLOCK_DEFAULT        1048576
+#define LZ77_BLOCK_MAX            16777216
+
+/* Worst case size of the compression of a block of n bytes */
+#define LZ77_BOUND(n)             ((n) + (n) / 255 + 16)
+
+/* Opaque type representing the compression instance */
+typedef struct __lz77_instance lz77_instance;
+
+/* Allocate and return an instance of lz77 compressor
+   cmode:   specify compress/decompress mode
+   bsize:   specify the size of the blocks (byte)
+ */
+lz77_instance* lz77_new(uint8_t cmode, uint32_t bsize);
+
+/* Compress the input stream by sending the result to the output stream
+   arg:     current instance of compressor obtained by invoking lz77_new()
+   Return:  one of defined lz77-level return codes
+ */
+uint8_t lz77_compress(lz77_instance* lz77, int fd_in, int fd_out);
+
+/* Decompress the input stream by sending the result to the output stream
+   arg:     current instance of compressor obtained by invoking lz77_new()
+   Return:  one of defined lz77-level return codes
+ */
+uint8_t lz77_decompress(lz77_instance* lz77, int fd_in, int fd_out);
+
+/* Compress a memory buffer as a single block
+   out:     buffer of at least LZ77_BOUND(n_in) bytes
+   n_out:   size of the compressed block
+   Return:  one of defined lz77-level return codes
+ */
+uint8_t lz77_compress_mem(lz77_instance* lz77, const char* in, uint32_t n_in,
+                          char* out, uint32_t* n_out);
+
+/* Decompress a single block held in memory
+   n_out:   exact size of the decompressed block
+   Return:  one of defined lz77-level return codes
+ */
+uint8_t lz77_decompress_mem(lz77_instance* lz77, const char* in, uint32_t n_in,
+                            char* out, uint32_t n_out);
+
+/* Deallocate current instance */
+void lz77_destroy(lz77_instance* lz77);
+
+#endif /* __LZ77_H */
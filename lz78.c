@@ -17,31 +17,103 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 
 #include "lz78.h"
+#include "ring.h"
 
+/* Control codes follow the a symbols of the alphabet (256 bytes, or 65536
+   16-bit symbols) and precede the first phrase */
 /* Code used to represent an EOF */
-#define DICT_CODE_EOF    256
-/* Code used before to send the size of the dictionary */
-#define DICT_CODE_SIZE   257
+#define DICT_CODE_EOF(a)    (a)
+/* Code starting a stream of 16-bit symbols (instead of DICT_CODE_START);
+   used by the compressor as state before emitting an odd trailing byte */
+#define DICT_CODE_SIZE(a)   ((a) + 1)
 /* Code used by the compressor to start the operations */
-#define DICT_CODE_START  258
-/* Code used by the compressor to stop the operations */
-#define DICT_CODE_STOP   259
+#define DICT_CODE_START(a)  ((a) + 2)
+/* Code used by the compressor to stop the operations; in a stream of 16-bit
+   symbols it precedes the odd trailing byte */
+#define DICT_CODE_STOP(a)   ((a) + 3)
+/* Code of a flush point (the start code inside a stream): the padding up to
+   the next byte follows */
+#define DICT_CODE_FLUSH(a)  DICT_CODE_START(a)
+/* First code of the phrases */
+#define DICT_CODE_FIRST(a)  ((a) + 4)
+
+/* Number of symbols of the byte alphabet (the start code of every stream
+   belongs to it) */
+#define ALPHABET_BYTE    256
+/* Number of symbols of the 16-bit alphabet */
+#define ALPHABET_WIDE    65536
 
 /* Limits dict_size inside [DICT_SIZE_MIN, DICT_SIZE_MAX] */
 #ifndef DICT_LIMIT
 #define DICT_LIMIT(x) (((x) < (DICT_SIZE_MIN + 1)) ? (DICT_SIZE_MIN + 1) : (((x) > (DICT_SIZE_MAX)) ? (DICT_SIZE_MAX) : (x)))
 #endif
 
+/* Limits dict_size for an alphabet of w bytes per symbol */
+#define DICT_LIMIT_WIDTH(x, w) (((w) == 1) ? DICT_LIMIT(x) : \
+        (((x) < DICT_SIZE_MIN_WIDE) ? DICT_SIZE_MIN_WIDE : DICT_LIMIT(x)))
+
 /* Compute the threshold for the start of secondary dictionary */
 #define DICT_SIZE_THRESHOLD(x) ((x) * 8 / 10)
 
+/* Size of the chunks moved between the stages of the pipelined mode */
+#define PIPE_CHUNK       262144
+/* Number of chunks in flight between two stages */
+#define PIPE_DEPTH       8
+
+/* Number and size of the samples parsed by lz78_estimate() */
+#define ESTIMATE_SAMPLES 16
+#define ESTIMATE_SAMPLE  65536
+
+/* Steps of a flush point emitted by the compressor */
+#define FLUSH_NONE       0
+#define FLUSH_PHRASE     1
+#define FLUSH_CODE       2
+#define FLUSH_ALIGN      3
+
+/* Number of bytes compressed between two checks of the flush interval */
+#define FLUSH_CHECK      65536
+
+/* Interval between flush points of a followed file, unless one is set, and
+   maximum wait for its appends (ms) */
+#define FOLLOW_FLUSH_MS  1000
+#define FOLLOW_POLL      1000
+/* Size of the buffer of the inotify events */
+#define FOLLOW_EVENTS    4096
+
+/* Side index of the checkpoints of a stream: a header (magic, version,
+   bytes per symbol, start and size codes of the stream) followed by the
+   checkpoints (offset of the data, offset of the next code in bits, number
+   of entries of the main dictionary), each followed by its entries (parent
+   in 3 bytes and label), all little endian */
+#define INDEX_MAGIC      "LZ7C"
+#define INDEX_VERSION    1
+#define INDEX_HEADER     16
+#define INDEX_CHECKPOINT 20
+/* Size of the buffers of the index and of the data of a range */
+#define INDEX_BUFFER     65536
+
+/* Flags of the entries of the compressed-domain search */
+#define GREP_MATCH       1
+#define GREP_NEWLINE     2
+
+/* Size of the output buffers of the iovec functions */
+#define IOV_SEGMENT      262144
+
 /* Entry of the hash table used by the compressor to encode data */
 struct __ht_entry {
     uint8_t used;             /* Flag indicating if the node is used or not */
@@ -59,6 +131,8 @@ struct __ht_dictionary {
     uint32_t cur_node;        /* Current position inside the dictionary */
     uint32_t prev_node;       /* Pointer to the father of cur_node */
     uint32_t d_size;          /* Size of the dictionary */
+    uint8_t width;            /* Bytes per symbol (1 or 2) */
+    uint32_t d_first;         /* First code of the phrases */
     uint32_t d_thr;           /* Threshold for activation of secondary dictionary */
     uint32_t d_next;          /* Next code to put in the dictionary */
 };
@@ -70,15 +144,55 @@ typedef struct __ht_dictionary ht_dictionary;
 struct __lz78_c {
     uint8_t completed;        /* Termination flag */
     uint32_t d_size;          /* Size of the dictionaries */
+    uint8_t width;            /* Bytes per symbol (1 or 2) */
+    uint32_t alphabet;        /* Number of symbols */
+    int half;                 /* First byte of the pending symbol (-1 none) */
     ht_dictionary* main;      /* Main dictionary */
     ht_dictionary* secondary; /* Secondary dictionary */
     uint32_t bitbuf;          /* Buffer containing bits not yet written */
     uint32_t n_bits;          /* Number of valid bits in the buffer */
+    const char* prime;        /* Data priming the dictionary of the stream */
+    uint32_t n_prime;         /* Size of the priming data */
+    uint8_t flush;            /* Step of the pending flush point */
+    uint8_t flushed;          /* Flag indicating the current phrase has been
+                                 emitted by a flush point */
+    uint32_t flush_ms;        /* Interval between flush points (0 never) */
+    uint32_t flush_lines;     /* Lines between flush points (0 never) */
+    uint32_t lines;           /* Lines compressed since the last flush point */
+    uint64_t dirty;           /* Time of the first byte compressed since the
+                                 last flush point (ms, 0 none) */
+    uint8_t follow;           /* Flag enabling the wait for data appended to
+                                 the input at its end */
+    volatile uint8_t stop;    /* Flag ending a followed input at its end */
+    FILE* in;                 /* Input of the compression to be resumed after
+                                 LZ78_ERROR_EAGAIN (NULL none) */
+    bit_file* out;            /* Output of the same compression */
 };
 
 /* The opaque type representing the state of the compressor */
 typedef struct __lz78_c lz78_c;
 
+/* Bit packer writing codes into memory */
+struct __bit_packer {
+    uint8_t* p;               /* Next byte to write */
+    uint64_t acc;             /* Bits not yet written */
+    uint32_t n_acc;           /* Number of valid bits in acc */
+};
+
+/* The opaque type of a bit packer */
+typedef struct __bit_packer bit_packer;
+
+/* Bit unpacker reading codes from memory */
+struct __bit_unpacker {
+    const uint8_t* p;         /* Next byte to read */
+    const uint8_t* end;       /* End of the input */
+    uint64_t acc;             /* Bits not yet consumed */
+    uint32_t n_acc;           /* Number of valid bits in acc */
+};
+
+/* The opaque type of a bit unpacker */
+typedef struct __bit_unpacker bit_unpacker;
+
 /* Entry of the dictionary used by the decompressor */
 struct __entry {
     uint32_t parent;          /* Parent node */
@@ -92,12 +206,15 @@ typedef struct __entry entry;
 struct __dictionary {
     entry* root;              /* Root node of the dictionary */
     uint32_t d_size;          /* Size of the dictionray */
+    uint8_t width;            /* Bytes per symbol (1 or 2) */
+    uint32_t d_first;         /* First code of the phrases */
     uint32_t d_thr;           /* Threshold for activation of secondary dictionary */
     uint32_t d_min;           /* Minimum size of the dictionary */
     uint32_t d_next;          /* Next code to put in the dictionary */
     uint32_t n_bytes;         /* Number of bytes contained in bytebuf */
     uint32_t offset;          /* Offset of the first valid byte inside bytebuf */
-    char bytebuf[0];          /* Buffer used to output strings */
+    char bytebuf[0];          /* Buffer used to output strings (d_size
+                                 symbols) */
 };
 
 /* The opaque type representing the dictionary used by the decompressor */
@@ -106,33 +223,148 @@ typedef struct __dictionary dictionary;
 /* State of the decompressor */
 struct __lz78_d {
     uint8_t completed;        /* Termination flag */
+    uint32_t alphabet;        /* Number of symbols (0 before the start code) */
+    uint8_t tail;             /* Flag indicating the odd trailing byte follows */
+    uint8_t flush;            /* Flag indicating a flush point: the next code
+                                 starts at the next byte */
     dictionary* main;         /* Main dictionary */
     ht_dictionary* secondary; /* Secondary dictionary */
     uint32_t bitbuf;          /* Buffer containing bits not yet written */
     uint32_t n_bits;          /* Number of valid bits contained in the buffer */
+    const char* prime;        /* Data priming the dictionary of the stream */
+    uint32_t n_prime;         /* Size of the priming data */
+    uint32_t swaps;           /* Number of swaps of the dictionaries */
+    bit_unpacker source;      /* Input of the phrase iterator */
+    bit_file* in;             /* Input of the decompression to be resumed
+                                 after LZ78_ERROR_EAGAIN (NULL none) */
+    FILE* out;                /* Output of the same decompression */
 };
 
 /* The opaque type representing the status of the decompressor */
 typedef struct __lz78_d lz78_d;
 
+/* Entry of the compressed-domain search: the state of the matcher of the
+   pattern P (of m bytes) after the phrase of the dictionary entry */
+struct __grep_entry {
+    uint64_t prefixes;        /* Suffixes of P prefixing the phrase (bit k:
+                                 P[k+1..m], 0 < k < m) */
+    uint8_t state;            /* Matcher state after the phrase from state 0 */
+    uint8_t factor;           /* Suffix automaton state after the phrase (0
+                                 if it is not a factor of P) */
+    uint8_t len;              /* Length of the phrase if a factor of P */
+    uint8_t flags;            /* GREP_MATCH (P inside), GREP_NEWLINE */
+    uint8_t first;            /* First byte of the phrase */
+};
+
+/* The opaque type of an entry of the compressed-domain search */
+typedef struct __grep_entry grep_entry;
+
+/* State of the compressed-domain search */
+struct __grep {
+    const char* pattern;      /* Pattern searched */
+    uint32_t m;               /* Length of the pattern */
+    uint8_t delta[LZ78_GREP_MAX + 1][256];
+                              /* Transitions of the matcher (KMP automaton) */
+    uint64_t chain[LZ78_GREP_MAX + 1];
+                              /* Failure chain of each state (bit k) */
+    uint8_t next[2 * LZ78_GREP_MAX][256];
+                              /* Transitions of the suffix automaton */
+    uint8_t link[2 * LZ78_GREP_MAX];
+                              /* Suffix links of the suffix automaton */
+    uint8_t length[2 * LZ78_GREP_MAX];
+                              /* Longest factor of each state */
+    uint8_t end[2 * LZ78_GREP_MAX];
+                              /* End of the first occurrence in P */
+    uint8_t terminal[2 * LZ78_GREP_MAX];
+                              /* Flag of the states of the suffixes of P */
+    grep_entry* entries;      /* Entries of the dictionary */
+    uint8_t state;            /* Matcher state after the last phrase */
+    uint8_t pending;          /* Flag indicating the current line matches */
+    uint8_t skip;             /* Flag indicating the first code of the line
+                                 ends the previous one */
+    uint32_t* codes;          /* Codes of the current line */
+    uint32_t n_codes;         /* Number of codes of the current line */
+    uint32_t codes_size;      /* Capacity of codes */
+    char* line;               /* Current line expanded */
+    size_t n_line;            /* Size of the expanded line */
+    size_t line_size;         /* Capacity of line */
+    char out[INDEX_BUFFER];   /* Buffer of the matching lines */
+    uint32_t n_out;           /* Bytes of the buffer of the matching lines */
+    int fd_out;               /* Output of the matching lines */
+};
+
+/* The opaque type representing the state of the compressed-domain search */
+typedef struct __grep grep;
+
+/* Entry of the statistics of a stream: totals of the phrase of the
+   dictionary entry */
+struct __info_entry {
+    uint32_t len;             /* Length of the phrase (bytes) */
+    uint32_t lines;           /* Newlines of the phrase */
+    uint32_t uses;            /* Codes of the phrase (or of its extensions)
+                                 since the last swap */
+    uint16_t first;           /* First symbol of the phrase */
+};
+
+/* The opaque type of an entry of the statistics of a stream */
+typedef struct __info_entry info_entry;
+
 /* lz78 instance descriptor */
 struct __lz78_instance {
     uint8_t mode;             /* Discriminate compression operations */
+    struct iovec* segments;   /* Output buffers of the iovec functions (each
+                                 of IOV_SEGMENT bytes, kept across calls) */
+    uint32_t n_segments;      /* Number of allocated output buffers */
     char state[0];            /* Compression/Decompression state struct */    
 };
 
+/* Chunk of data moved between two stages of the pipeline */
+struct __chunk {
+    uint32_t len;             /* Number of valid items */
+    uint8_t last;             /* Flag indicating the end of the stream */
+    char data[0];             /* Payload (contiguous memory area) */
+};
+
+/* The opaque type of a chunk of the pipeline */
+typedef struct __chunk chunk;
+
+/* Link between two stages: full chunks go forward, empty ones come back */
+struct __pipe_link {
+    ring* full;               /* Chunks ready for the next stage */
+    ring* empty;              /* Chunks ready to be filled again */
+    chunk* pool[PIPE_DEPTH];  /* Chunks owned by the link */
+};
+
+/* The opaque type of a link between two stages */
+typedef struct __pipe_link pipe_link;
+
+/* I/O stage of the pipeline running on its own thread */
+struct __pipe_stage {
+    int fd;                   /* File descriptor read or written */
+    pipe_link* link;          /* Link with the dictionary stage */
+    uint8_t ret;              /* lz78-level return code of the stage */
+};
+
+/* The opaque type of an I/O stage */
+typedef struct __pipe_stage pipe_stage;
+
 /* Return the number of bits needed to represent the given number */
 uint8_t bitlen(uint32_t i);
 
-/* Create a new ht_dictionary to be used for the compression */
-ht_dictionary* ht_dictionary_new(uint32_t d_size);
+/* Create a new ht_dictionary (of symbols of width bytes) to be used for the
+   compression */
+ht_dictionary* ht_dictionary_new(uint32_t d_size, uint8_t width);
 
-/* Update the dictionary depending with input byte
+/* Update the dictionary depending with input symbol
    Return:
      0   a new entry have been put in the dictionary
     -1   switch the current node
  */
-int ht_dictionary_update(ht_dictionary* d, uint16_t label);
+int ht_dictionary_update(ht_dictionary* d, uint32_t label);
+
+/* Add the entry of the current node followed by label without searching it
+   (the phrase of the current node has been emitted by a flush point) */
+void ht_dictionary_add(ht_dictionary* d, uint32_t label);
 
 /* Reset the dictionary associated to the given compressor */
 void ht_dictionary_reset(ht_dictionary* d);
@@ -140,8 +372,12 @@ void ht_dictionary_reset(ht_dictionary* d);
 /* Destroy the given ht_dictionary object */
 void ht_dictionary_destroy(ht_dictionary* d);
 
-/* Create a new dictionary to be used for the decompression */
-dictionary* dictionary_new(uint32_t d_size);
+/* Fill the dictionary by parsing the priming data without emitting codes */
+void ht_dictionary_prime(ht_dictionary* d, const char* data, uint32_t n);
+
+/* Create a new dictionary (of symbols of width bytes) to be used for the
+   decompression */
+dictionary* dictionary_new(uint32_t d_size, uint8_t width);
 
 /* Update the internal state of the dictionary */
 void dictionary_update(dictionary* d, uint32_t code);
@@ -149,15 +385,64 @@ void dictionary_update(dictionary* d, uint32_t code);
 /* Reset the dictionary associated to the given decompressor */
 void dictionary_reset(dictionary* d);
 
+/* Replace the main dictionary with the secondary one, then reset it */
+void dictionary_swap(dictionary* d_main, ht_dictionary* d_sec);
+
 /* Destroy the given dictionary object */
 void dictionary_destroy(dictionary* d);
 
+/* Fill the dictionary with the same entries ht_dictionary_prime() creates,
+   using scratch as temporary hash table */
+void dictionary_prime(dictionary* d, ht_dictionary* scratch, const char* data,
+                      uint32_t n);
+
 /* Compress the input byte and modifiy the state of the dictionary */
 void compress_byte(lz78_c* o, int c_in);
 
+/* Emit the next code of the pending flush point */
+void flush_code(lz78_c* o);
+
 /* Decompress the input code and modify the state of the dictionary */
 int decompress_code(lz78_d* o, uint32_t code);
 
+/* Append the lower bits of code to the packer */
+static inline void pack_code(bit_packer* b, uint32_t code, uint32_t bits) {
+    b->acc |= (uint64_t)(code & ((1 << bits) - 1)) << b->n_acc;
+    b->n_acc += bits;
+    while (b->n_acc >= 8) {
+        *(b->p)++ = b->acc;
+        b->acc >>= 8;
+        b->n_acc -= 8;
+    }
+}
+
+/* Write the last incomplete byte of the packer */
+static inline void pack_flush(bit_packer* b) {
+    if (b->n_acc > 0) {
+        *(b->p)++ = b->acc;
+        b->acc = 0;
+        b->n_acc = 0;
+    }
+}
+
+/* Extract a code of the given width from the unpacker
+   Return:
+     0   success
+    -1   end of input
+ */
+static inline int unpack_code(bit_unpacker* b, uint32_t bits, uint32_t* code) {
+    while (b->n_acc < bits) {
+        if (b->p == b->end)
+            return -1;
+        b->acc |= (uint64_t)*(b->p)++ << b->n_acc;
+        b->n_acc += 8;
+    }
+    *code = b->acc & ((1 << bits) - 1);
+    b->acc >>= bits;
+    b->n_acc -= bits;
+    return 0;
+}
+
 uint8_t bitlen(uint32_t i) {
     uint8_t n = 0;
     while (i) {
@@ -167,28 +452,43 @@ uint8_t bitlen(uint32_t i) {
     return n;
 }
 
-ht_dictionary* ht_dictionary_new(uint32_t d_size) {
+ht_dictionary* ht_dictionary_new(uint32_t d_size, uint8_t width) {
     ht_dictionary* dict = malloc(sizeof(ht_dictionary));
     if (dict == NULL)
         return NULL;
 
-    d_size = DICT_LIMIT(d_size);
+    d_size = DICT_LIMIT_WIDTH(d_size, width);
     dict->root = calloc(1, sizeof(ht_entry) * d_size);
     if (dict->root == NULL) {
         free(dict);
         return NULL;
     } else {
         dict->d_size = d_size;
+        dict->width = width;
+        dict->d_first = DICT_CODE_FIRST(1 << (8 * width));
         dict->d_thr = DICT_SIZE_THRESHOLD(d_size);
-        dict->d_next = DICT_SIZE_MIN;
+        dict->d_next = dict->d_first;
         dict->cur_node = -1;
         return dict;
     }
 }
 
-int ht_dictionary_update(ht_dictionary* d, uint16_t label) {
+/* Bernstein hash function of the current node followed by label (the label
+   is rotated so that no bit of a 16-bit symbol is lost) */
+static inline uint32_t ht_hash(ht_dictionary* d, uint32_t label) {
     uint8_t i;
-    uint32_t key;
+    uint8_t shift = bitlen(d->d_size);
+    uint32_t key = ((label << shift) | (label >> (32 - shift))) + d->cur_node;
+    uint32_t hash = 0;
+
+    for (i = 0; i < 4; ++i) {
+        hash = ((hash << 5) + hash) + (key & 0xFF);
+        key >>= 8;
+    }
+    return hash % d->d_size;
+}
+
+int ht_dictionary_update(ht_dictionary* d, uint32_t label) {
     uint32_t hash;
     d->prev_node = d->cur_node;
 
@@ -197,14 +497,7 @@ int ht_dictionary_update(ht_dictionary* d, uint16_t label) {
         return -1;
     }
 
-    /* Bernstein hash function */
-    key = (label << bitlen(d->d_size)) + d->cur_node;
-    hash = 0;
-    for (i = 0; i < 4; ++i) {
-        hash = ((hash << 5) + hash) + (key & 0xFF);
-        key >>= 8;
-    }
-    hash %= d->d_size;
+    hash = ht_hash(d, label);
 
     /* Search if current sequence is present, else return an empty hash entry
        where insert it */
@@ -234,24 +527,60 @@ int ht_dictionary_update(ht_dictionary* d, uint16_t label) {
     return 0;
 }
 
+void ht_dictionary_add(ht_dictionary* d, uint32_t label) {
+    uint32_t hash = ht_hash(d, label);
+
+    /* An entry with the same key found first shadows this one */
+    while (d->root[hash].used)
+        hash = (hash + 1) % d->d_size;
+
+    d->root[hash].used = 1;
+    d->root[hash].parent = d->cur_node;
+    d->root[hash].label = label;
+    d->root[hash].child = d->d_next;
+    d->prev_node = d->cur_node;
+    d->cur_node = label;
+    ++(d->d_next);
+}
+
 void ht_dictionary_reset(ht_dictionary* d) {
     memset(d->root, 0, sizeof(ht_entry) * d->d_size);
-    d->d_next = DICT_SIZE_MIN;
+    d->d_next = d->d_first;
     d->cur_node = -1;
 }
 
 void ht_dictionary_destroy(ht_dictionary* d) {
-    if (d != NULL)
+    if (d != NULL) {
+        free(d->root);
         free(d);
+    }
+}
+
+void ht_dictionary_prime(ht_dictionary* d, const char* data, uint32_t n) {
+    uint32_t i;
+
+    /* The parse stops before the secondary dictionary would be needed, so
+       that the stream starts in a state reachable without priming */
+    if (d->width == 1) {
+        for (i = 0; i < n && d->d_next < d->d_thr; ++i)
+            ht_dictionary_update(d, (uint8_t) data[i]);
+    } else {
+        for (i = 0; i + 1 < n && d->d_next < d->d_thr; i += 2)
+            ht_dictionary_update(d, (uint8_t) data[i] |
+                                 (uint8_t) data[i + 1] << 8);
+    }
+    d->cur_node = -1;
 }
 
-dictionary* dictionary_new(uint32_t d_size) {
-    uint16_t i;
-    dictionary* dict = malloc(sizeof(dictionary) + d_size);
+dictionary* dictionary_new(uint32_t d_size, uint8_t width) {
+    uint32_t i;
+    dictionary* dict;
+
+    d_size = DICT_LIMIT_WIDTH(d_size, width);
+    dict = malloc(sizeof(dictionary) + d_size * width);
     if (dict == NULL)
         return NULL;
 
-    d_size = DICT_LIMIT(d_size);
     dict->root = malloc(sizeof(entry) * d_size);
     if (dict->root == NULL) {
         free(dict);
@@ -259,10 +588,14 @@ dictionary* dictionary_new(uint32_t d_size) {
     }
 
     dict->d_size = d_size;
+    dict->width = width;
+    dict->d_first = DICT_CODE_FIRST(1 << (8 * width));
     dict->d_thr = DICT_SIZE_THRESHOLD(d_size);
-    dict->d_min = DICT_SIZE_MIN;
-    dict->d_next = DICT_SIZE_MIN;
-    for (i = 0; i < DICT_SIZE_MIN; ++i) {
+    dict->d_min = dict->d_first;
+    dict->d_next = dict->d_first;
+    dict->n_bytes = 0;
+    dict->offset = 0;
+    for (i = 0; i < dict->d_first; ++i) {
         dict->root[i].parent = 0;
         dict->root[i].label = i;
     }
@@ -270,27 +603,41 @@ dictionary* dictionary_new(uint32_t d_size) {
 }
 
 void dictionary_update(dictionary* d, uint32_t code) {
-    uint32_t d_size = d->d_size - 1;
+    uint32_t d_size = d->d_size * d->width - 1;
     uint32_t d_next = d->d_next;
     uint32_t d_min = d->d_min;
     uint32_t i = d_size;
     uint32_t p = code;
 
-    /* Recover original sequence */
-    while (1) {
-        d->bytebuf[i--] = d->root[p].label;
-        if (p < DICT_SIZE_MIN || i == 0)
-            break;
-        p = d->root[p].parent;
+    /* Recover original sequence (16-bit symbols are little endian) */
+    if (d->width == 1) {
+        while (1) {
+            d->bytebuf[i--] = d->root[p].label;
+            if (p < d->d_first || i == 0)
+                break;
+            p = d->root[p].parent;
+        }
+    } else {
+        while (1) {
+            d->bytebuf[i--] = d->root[p].label >> 8;
+            d->bytebuf[i--] = d->root[p].label;
+            if (p < d->d_first || i < 2)
+                break;
+            p = d->root[p].parent;
+        }
     }
 
-    /* Fill last char with the first char of the sequence */
+    /* Fill last symbol with the first symbol of the sequence */
     if (code >= d_min && code == d_next - 1)
-        d->bytebuf[d_size] = d->bytebuf[i + 1];
+        memcpy(d->bytebuf + d_size + 1 - d->width, d->bytebuf + i + 1,
+               d->width);
 
     /* Update last incomplete entry of the dictionary */
-    if (d_next > d_min)
+    if (d_next > d_min && d->width == 1)
         d->root[d_next - 1].label = d->bytebuf[i + 1];
+    else if (d_next > d_min)
+        d->root[d_next - 1].label = (uint8_t) d->bytebuf[i + 1] |
+                                    (uint8_t) d->bytebuf[i + 2] << 8;
 
     /* Update */
     d->n_bytes = d_size - i;
@@ -300,8 +647,24 @@ void dictionary_update(dictionary* d, uint32_t code) {
 }
 
 void dictionary_reset(dictionary* d) {
-    d->d_min = DICT_SIZE_MIN;
-    d->d_next = DICT_SIZE_MIN;
+    d->d_min = d->d_first;
+    d->d_next = d->d_first;
+}
+
+void dictionary_swap(dictionary* d_main, ht_dictionary* d_sec) {
+    uint32_t i;
+
+    dictionary_reset(d_main);
+    d_main->d_min = d_sec->d_next;
+    d_main->d_next = d_sec->d_next;
+    for (i = 0; i < d_sec->d_size && d_sec->d_next; ++i) {
+        if (d_sec->root[i].used) {
+            d_main->root[d_sec->root[i].child].parent = d_sec->root[i].parent;
+            d_main->root[d_sec->root[i].child].label = d_sec->root[i].label;
+            --(d_sec->d_next);
+        }
+    }
+    ht_dictionary_reset(d_sec);
 }
 
 void dictionary_destroy(dictionary* d) {
@@ -311,40 +674,87 @@ void dictionary_destroy(dictionary* d) {
     }
 }
 
+void dictionary_prime(dictionary* d, ht_dictionary* scratch, const char* data,
+                      uint32_t n) {
+    uint32_t i;
+
+    ht_dictionary_prime(scratch, data, n);
+    for (i = 0; i < scratch->d_size; ++i) {
+        if (scratch->root[i].used) {
+            d->root[scratch->root[i].child].parent = scratch->root[i].parent;
+            d->root[scratch->root[i].child].label = scratch->root[i].label;
+        }
+    }
+    /* Primed entries are complete as the ones inherited on swaps */
+    d->d_min = scratch->d_next;
+    d->d_next = scratch->d_next;
+    ht_dictionary_reset(scratch);
+}
+
 void compress_byte(lz78_c* o, int c_in) {
     /* Optimization pointers */
     ht_dictionary* d_main = o->main;
     ht_dictionary* d_sec = o->secondary;
+    uint32_t a = o->alphabet;
 
-    switch(d_main->cur_node) {
-    case DICT_CODE_START:
+    /* Control states of the compressor are the control codes */
+    if (d_main->cur_node >= a && d_main->cur_node < DICT_CODE_FIRST(a)) {
+        if (d_main->cur_node == DICT_CODE_START(a)) {
             o->bitbuf = d_main->d_size;
             o->n_bits = bitlen(DICT_SIZE_MAX);
             d_main->cur_node = -1;
-            break;
-    case DICT_CODE_EOF:
+            if (o->n_prime > 0) {
+                ht_dictionary_prime(d_main, o->prime, o->n_prime);
+                o->n_prime = 0;
+            }
+        } else if (d_main->cur_node == DICT_CODE_EOF(a) && o->half != -1) {
+            o->bitbuf = DICT_CODE_STOP(a);
+            o->n_bits = bitlen(d_main->d_next);
+            d_main->cur_node = DICT_CODE_SIZE(a);
+            return;
+        } else if (d_main->cur_node == DICT_CODE_SIZE(a)) {
+            /* Odd trailing byte of a stream of 16-bit symbols */
+            o->bitbuf = o->half;
+            o->n_bits = bitlen(d_main->d_next);
+            o->half = -1;
+            d_main->cur_node = DICT_CODE_EOF(a);
+            return;
+        } else if (d_main->cur_node == DICT_CODE_EOF(a)) {
             o->bitbuf = d_main->cur_node;
             o->n_bits = bitlen(d_main->d_next);
-            d_main->cur_node = DICT_CODE_STOP;
+            d_main->cur_node = DICT_CODE_STOP(a);
             return;
-        case DICT_CODE_STOP:
+        } else {
             o->completed = 1;
             return;
-    default:
-            break;
+        }
     }
 
-    c_in = c_in == EOF ? DICT_CODE_EOF : c_in;
-    /* Dictonaries update */
-    if (ht_dictionary_update(d_main, c_in) != 0) {
+    if (c_in == EOF) {
+        c_in = DICT_CODE_EOF(a);
+    } else if (o->width == 2) {
+        /* Two bytes make a symbol */
+        if (o->half == -1) {
+            o->half = c_in;
+            return;
+        }
+        c_in = o->half | c_in << 8;
+        o->half = -1;
+    }
+    /* Dictonaries update (the phrase preceding a flush point has already
+       been emitted: only its entry is added) */
+    if (o->flushed) {
+        ht_dictionary_add(d_main, c_in);
+        o->flushed = 0;
+    } else if (ht_dictionary_update(d_main, c_in) != 0) {
         if (d_main->d_next >= d_main->d_thr)
             ht_dictionary_update(d_sec, c_in);
         return;
+    } else {
+        o->bitbuf = d_main->prev_node;
+        o->n_bits = bitlen(d_main->d_next - 1);
     }
 
-    o->bitbuf = d_main->prev_node;
-    o->n_bits = bitlen(d_main->d_next - 1);
-
     /* Dictonaries swap */
     if (d_main->d_next == d_main->d_size) {
         o->main = o->secondary;
@@ -359,6 +769,40 @@ void compress_byte(lz78_c* o, int c_in) {
         ht_dictionary_update(d_sec, c_in);
 }
 
+void flush_code(lz78_c* o) {
+    ht_dictionary* d_main = o->main;
+    uint32_t a = o->alphabet;
+
+    /* Nothing to flush before the first symbol and after the last one */
+    if (d_main->cur_node >= a && d_main->cur_node < DICT_CODE_FIRST(a)) {
+        o->flush = FLUSH_NONE;
+        return;
+    }
+
+    /* The current phrase is emitted as if the next symbol did not extend
+       it; the entry of the phrase is added by that symbol, unless the
+       decoder swaps the dictionaries on it */
+    if (o->flush == FLUSH_PHRASE && d_main->cur_node != -1 && !o->flushed) {
+        o->bitbuf = d_main->cur_node;
+        o->n_bits = bitlen(d_main->d_next);
+        o->flush = FLUSH_CODE;
+        if (d_main->d_next + 1 < d_main->d_size) {
+            o->flushed = 1;
+        } else {
+            o->main = o->secondary;
+            o->secondary = d_main;
+            o->main->cur_node = -1;
+            ht_dictionary_reset(d_main);
+        }
+        return;
+    }
+
+    /* The decoder has already counted the entry of a flushed phrase */
+    o->bitbuf = DICT_CODE_FLUSH(a);
+    o->n_bits = bitlen(o->main->d_next + o->flushed);
+    o->flush = FLUSH_ALIGN;
+}
+
 int decompress_code(lz78_d* o, uint32_t code) {
     uint32_t i;
     int c_in;
@@ -366,30 +810,81 @@ int decompress_code(lz78_d* o, uint32_t code) {
     dictionary* d_main = o->main;
     ht_dictionary* d_sec = o->secondary;
 
-    switch(code) {
-    case DICT_CODE_EOF:
+    uint32_t a = o->alphabet;
+    uint8_t width = (a == ALPHABET_WIDE) ? 2 : 1;
+
+    /* The start code selects the alphabet and precedes the size */
+    if (a == 0) {
+        if (code == DICT_CODE_START(ALPHABET_BYTE))
+            o->alphabet = ALPHABET_BYTE;
+        else if (code == DICT_CODE_SIZE(ALPHABET_BYTE))
+            o->alphabet = ALPHABET_WIDE;
+        else
+            return -2;
+        d_main->d_next = DICT_SIZE_MAX;
+        o->n_bits = 0;
+        return 0;
+    }
+
+    if (d_main->d_next != DICT_SIZE_MAX && o->tail) {
+        /* Odd trailing byte of a stream of 16-bit symbols */
+        if (code >= ALPHABET_BYTE)
+            return -2;
+        d_main->bytebuf[0] = code;
+        d_main->offset = 0;
+        d_main->n_bytes = 1;
+        o->tail = 0;
+        return 0;
+    }
+
+    switch(code - a) {
+    case DICT_CODE_EOF(0):
             o->completed = 1;
             return 0;
-    case DICT_CODE_START:
-        case DICT_CODE_SIZE:
-            d_main->d_next = DICT_SIZE_MAX;
-            o->n_bits = 0;
+    case DICT_CODE_STOP(0):
+            if (width == 1)
+                return -2;
+            d_main->n_bytes = 0;
+            o->tail = 1;
             return 0;
+    case DICT_CODE_FLUSH(0):
+            if (d_main->d_next != DICT_SIZE_MAX) {
+                d_main->n_bytes = 0;
+                o->flush = 1;
+                return 0;
+            }
+            break;
+    case DICT_CODE_SIZE(0):
+            if (d_main->d_next != DICT_SIZE_MAX)
+                return -2;
+            break;
     default:
             /* Initial operations */
             if (d_main->d_next == DICT_SIZE_MAX) {
-                dictionary_destroy(d_main);
-                d_main = dictionary_new(code);
-                o->main = d_main;
-                if (d_main == NULL)
-                    return -1;
-                ht_dictionary_destroy(d_sec);
-                d_sec = ht_dictionary_new(code);
-                o->secondary = d_sec;
-                if (d_sec == NULL) {
+                /* Dictionaries of a previous stream are reused if possible */
+                if (d_sec != NULL && d_sec->width == width &&
+                        d_sec->d_size == DICT_LIMIT_WIDTH(code, width) &&
+                        d_main->d_size == DICT_LIMIT_WIDTH(code, width)) {
+                    dictionary_reset(d_main);
+                    ht_dictionary_reset(d_sec);
+                } else {
                     dictionary_destroy(d_main);
-                    o->main = NULL;
-                    return -1;
+                    d_main = dictionary_new(code, width);
+                    o->main = d_main;
+                    if (d_main == NULL)
+                        return -1;
+                    ht_dictionary_destroy(d_sec);
+                    d_sec = ht_dictionary_new(code, width);
+                    o->secondary = d_sec;
+                    if (d_sec == NULL) {
+                        dictionary_destroy(d_main);
+                        o->main = NULL;
+                        return -1;
+                    }
+                }
+                if (o->n_prime > 0) {
+                    dictionary_prime(d_main, d_sec, o->prime, o->n_prime);
+                    o->n_prime = 0;
                 }
                 o->bitbuf = 0;
                 o->n_bits = 0;
@@ -399,34 +894,29 @@ int decompress_code(lz78_d* o, uint32_t code) {
     }
 
     /* Bad compressed file */
-    if (d_sec == NULL || d_main == NULL)
+    if (d_sec == NULL || d_main == NULL || code >= d_main->d_next)
         return -2;
 
     dictionary_update(d_main, code);
 
     /* Update of secondary if threshold is reached */
-    if (d_main->d_next > d_main->d_thr) {
+    if (d_main->d_next > d_main->d_thr && width == 1) {
         for (i = 0; i < d_main->n_bytes; ++i) {
             c_in = (uint8_t) d_main->bytebuf[d_main->offset + i];
             ht_dictionary_update(d_sec, c_in);
         }
+    } else if (d_main->d_next > d_main->d_thr) {
+        for (i = 0; i < d_main->n_bytes; i += 2) {
+            c_in = (uint8_t) d_main->bytebuf[d_main->offset + i] |
+                   (uint8_t) d_main->bytebuf[d_main->offset + i + 1] << 8;
+            ht_dictionary_update(d_sec, c_in);
+        }
     }
 
     /* Dictonaries swap */
     if (d_main->d_next == d_main->d_size) {
-        dictionary_reset(d_main);
-        d_main->d_min = d_sec->d_next;
-        d_main->d_next = d_sec->d_next;
-        for (i = 0; i < d_sec->d_size && d_sec->d_next; ++i) {
-            if (d_sec->root[i].used) {
-                d_main->root[d_sec->root[i].child].parent =
-                        d_sec->root[i].parent;
-                d_main->root[d_sec->root[i].child].label =
-                        d_sec->root[i].label;
-                --(d_sec->d_next);
-            }
-        }
-        ht_dictionary_reset(d_sec);
+        dictionary_swap(d_main, d_sec);
+        ++(o->swaps);
     }
     return 0;
 }
@@ -441,6 +931,8 @@ lz78_instance* lz78_new(uint8_t cmode, uint32_t dsize) {
     if (i == NULL)
         return NULL;
     i->mode = cmode;
+    i->segments = NULL;
+    i->n_segments = 0;
 
     switch (cmode) {
         case LZ78_MODE_COMPRESS:
@@ -448,26 +940,53 @@ lz78_instance* lz78_new(uint8_t cmode, uint32_t dsize) {
             dsize = (dsize == 0) ? DICT_SIZE_DEFAULT : dsize;
             c->d_size = DICT_LIMIT(dsize);
             c->completed = 0;
-            c->main = ht_dictionary_new(c->d_size);
+            c->n_prime = 0;
+            c->width = 1;
+            c->alphabet = ALPHABET_BYTE;
+            c->half = -1;
+            c->flush = FLUSH_NONE;
+            c->flushed = 0;
+            c->flush_ms = 0;
+            c->flush_lines = 0;
+            c->lines = 0;
+            c->dirty = 0;
+            c->follow = 0;
+            c->stop = 0;
+            c->in = NULL;
+            c->out = NULL;
+            c->main = ht_dictionary_new(c->d_size, c->width);
             if (c->main == NULL) {
                 free(i);
                 return NULL;
             }
-            c->secondary = ht_dictionary_new(c->d_size);
+            c->secondary = ht_dictionary_new(c->d_size, c->width);
             if (c->secondary == NULL) {
                 ht_dictionary_destroy(c->main);
                 free(i);
                 return NULL;
             }
-            c->bitbuf = DICT_CODE_START;
+            c->bitbuf = DICT_CODE_START(ALPHABET_BYTE);
             c->n_bits = bitlen(DICT_SIZE_MIN);
-            c->main->cur_node = DICT_CODE_START;
+            c->main->cur_node = DICT_CODE_START(c->alphabet);
             return i;
 
         case LZ78_MODE_DECOMPRESS:
             d = (lz78_d*)&i->state; 
             d->completed = 0;
-            d->main = dictionary_new(DICT_SIZE_MIN);
+            d->n_prime = 0;
+            d->alphabet = 0;
+            d->tail = 0;
+            d->flush = 0;
+            d->swaps = 0;
+            d->source.p = d->source.end = NULL;
+            d->source.acc = 0;
+            d->source.n_acc = 0;
+            d->bitbuf = 0;
+            d->n_bits = 0;
+            d->in = NULL;
+            d->out = NULL;
+            d->secondary = NULL;
+            d->main = dictionary_new(DICT_SIZE_MIN, 1);
             if (d->main == NULL) {
                 free(i);
                 return NULL;
@@ -479,28 +998,74 @@ lz78_instance* lz78_new(uint8_t cmode, uint32_t dsize) {
     }
 }
 
-uint8_t lz78_compress(lz78_instance* lz78, int fd_in, int fd_out) {
-    FILE* in;
-    bit_file* out;
-    lz78_c* o;
-    int bits;
-    int c_in;
-
-    if (lz78 == NULL)
-        return LZ78_ERROR_INITIALIZATION;
+/* Return the time of the monotonic clock (milliseconds) */
+static uint64_t clock_ms(void) {
+    struct timespec t;
 
-    if (lz78->mode != LZ78_MODE_COMPRESS)
-        return LZ78_ERROR_MODE;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
 
-    in = fdopen(fd_in, "r");
-    if (in == NULL)
-        return LZ78_ERROR_READ;
+/* Wait for data appended to a followed input at its end (ifd watches it),
+   requesting the flush point which is due meanwhile; a file which has been
+   removed or renamed ends at its end, a truncated one is followed from its
+   start */
+static void follow_wait(lz78_c* o, FILE* in, int fd_in, int ifd) {
+    char events[FOLLOW_EVENTS]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event* e;
+    struct pollfd pfd;
+    struct stat st;
+    uint64_t now = clock_ms();
+    int timeout = FOLLOW_POLL;
+    ssize_t n;
+    char* p;
+
+    clearerr(in);
+    if (o->dirty != 0) {
+        if (now >= o->dirty + o->flush_ms) {
+            o->flush = FLUSH_PHRASE;
+            return;
+        }
+        if (o->dirty + o->flush_ms - now < FOLLOW_POLL)
+            timeout = o->dirty + o->flush_ms - now;
+    }
 
-    out = bit_open(fd_out, ACCESS_WRITE, B_SIZE_DEFAULT);
-    if (out == NULL)
-        return LZ78_ERROR_WRITE;
+    pfd.fd = ifd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, timeout) > 0) {
+        while ((n = read(ifd, events, sizeof(events))) > 0) {
+            for (p = events; p < events + n; p += sizeof(*e) + e->len) {
+                e = (struct inotify_event*) p;
+                if (e->mask & (IN_MOVE_SELF | IN_DELETE_SELF))
+                    o->stop = 1;
+            }
+        }
+    }
+    errno = 0;
+
+    /* An unlinked file stays readable while it is open */
+    if (fstat(fd_in, &st) == 0) {
+        if (st.st_nlink == 0)
+            o->stop = 1;
+        else if (st.st_size < ftello(in))
+            fseeko(in, 0, SEEK_SET);
+    }
+}
 
-    o = (lz78_c*)&lz78->state;
+/* Compress the input stream emitting the flush points requested by the
+   caller, by the number of lines or by the interval (input which would
+   block is waited for only when an interval is set, appends to a followed
+   input when ifd is not -1)
+   Return:  one of defined lz78-level return codes
+ */
+static uint8_t compress_stream(lz78_c* o, FILE* in, bit_file* out,
+                               int fd_in, int ifd) {
+    struct pollfd pfd;
+    uint32_t count = 0;
+    uint64_t now;
+    int bits;
+    int c_in;
 
     for (;;) {
 
@@ -516,47 +1081,144 @@ uint8_t lz78_compress(lz78_instance* lz78, int fd_in, int fd_out) {
                 return LZ78_ERROR_EAGAIN;
         }
 
+        /* The end of the stream is written out before closing */
+        if (o->completed == 1) {
+            if (bit_align(out) == -1 || bit_flush(out) == -1)
+                return LZ78_ERROR_WRITE;
+            if (bit_pending(out) > 0)
+                return LZ78_ERROR_EAGAIN;
+            bit_close(out);
+            return LZ78_SUCCESS;
+        }
+
+        /* Codes of a flush point, then the padding up to the next byte */
+        if (o->flush == FLUSH_ALIGN) {
+            o->flush = FLUSH_NONE;
+            o->lines = 0;
+            o->dirty = 0;
+            if (bit_align(out) == -1 || bit_flush(out) == -1)
+                return LZ78_ERROR_WRITE;
+        } else if (o->flush != FLUSH_NONE) {
+            flush_code(o);
+            continue;
+        }
+
         c_in = fgetc(in);
         if (c_in == EOF) {
-            if (errno == EAGAIN) {
+            if (errno == EAGAIN && o->flush_ms > 0) {
+                /* Idle input: flush at the end of the interval */
+                errno = 0;
+                clearerr(in);
+                now = clock_ms();
+                if (o->dirty != 0 && now >= o->dirty + o->flush_ms) {
+                    o->flush = FLUSH_PHRASE;
+                    continue;
+                }
+                pfd.fd = fd_in;
+                pfd.events = POLLIN;
+                poll(&pfd, 1, o->dirty ? o->dirty + o->flush_ms - now : -1);
+                errno = 0;
+                continue;
+            } else if (errno == EAGAIN) {
                 errno = 0;
+                clearerr(in);
                 return LZ78_ERROR_EAGAIN;
             } else if (errno != 0) {
                 return LZ78_ERROR_READ;
+            } else if (ifd != -1 && !o->stop) {
+                follow_wait(o, in, fd_in, ifd);
+                continue;
             }
         }
 
         compress_byte(o, c_in);
-        if (o->completed == 1) {
-            bit_close(out);
-            return LZ78_SUCCESS;
-        }
+        if (c_in == EOF)
+            continue;
+        if (c_in == '\n' && o->flush_lines > 0 &&
+                ++o->lines == o->flush_lines)
+            o->flush = FLUSH_PHRASE;
+        if (o->flush_ms > 0 && o->dirty == 0)
+            o->dirty = clock_ms();
+        else if (o->flush_ms > 0 && ++count % FLUSH_CHECK == 0 &&
+                 clock_ms() >= o->dirty + o->flush_ms)
+            o->flush = FLUSH_PHRASE;
     }
 }
 
-uint8_t lz78_decompress(lz78_instance* lz78, int fd_in, int fd_out) {
-    bit_file* in;
-    FILE* out;
-    lz78_d* o;
-    dictionary* d_main;
-    uint32_t bits, written;
-    int ret;
+uint8_t lz78_compress(lz78_instance* lz78, int fd_in, int fd_out) {
+    FILE* in;
+    bit_file* out;
+    lz78_c* o;
+    struct stat st;
+    char path[32];
+    int flags = -1;
+    int ifd = -1;
+    uint8_t ret;
 
     if (lz78 == NULL)
         return LZ78_ERROR_INITIALIZATION;
 
-    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+    if (lz78->mode != LZ78_MODE_COMPRESS)
         return LZ78_ERROR_MODE;
 
-    in = bit_open(fd_in, ACCESS_READ, B_SIZE_DEFAULT);
-    if (in == NULL)
-        return LZ78_ERROR_READ;
+    o = (lz78_c*)&lz78->state;
 
-    out = fdopen(fd_out, "w");
-    if (out == NULL)
-        return LZ78_ERROR_WRITE;
+    /* A compression suspended by LZ78_ERROR_EAGAIN resumes with the data
+       buffered by its streams */
+    if (o->out != NULL) {
+        in = o->in;
+        out = o->out;
+    } else {
+        in = fdopen(fd_in, "r");
+        if (in == NULL)
+            return LZ78_ERROR_READ;
 
-    o = (lz78_d*) &lz78->state;
+        out = bit_open(fd_out, ACCESS_WRITE, B_SIZE_DEFAULT);
+        if (out == NULL)
+            return LZ78_ERROR_WRITE;
+    }
+
+    /* The input is read without blocking while an interval is set, so that
+       flush points are emitted while it is idle */
+    if (o->flush_ms > 0) {
+        flags = fcntl(fd_in, F_GETFL);
+        if (flags == -1 || fcntl(fd_in, F_SETFL, flags | O_NONBLOCK) == -1)
+            return LZ78_ERROR_READ;
+    }
+
+    /* Appends to a regular file are waited for with inotify */
+    if (o->follow && fstat(fd_in, &st) == 0 && S_ISREG(st.st_mode)) {
+        ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", fd_in);
+        if (ifd == -1 || inotify_add_watch(ifd, path, IN_MODIFY | IN_ATTRIB |
+                                           IN_MOVE_SELF | IN_DELETE_SELF) == -1) {
+            if (ifd != -1)
+                close(ifd);
+            if (flags != -1)
+                fcntl(fd_in, F_SETFL, flags);
+            return LZ78_ERROR_READ;
+        }
+    }
+
+    ret = compress_stream(o, in, out, fd_in, ifd);
+    o->in = (ret == LZ78_ERROR_EAGAIN) ? in : NULL;
+    o->out = (ret == LZ78_ERROR_EAGAIN) ? out : NULL;
+
+    if (ifd != -1)
+        close(ifd);
+    if (flags != -1)
+        fcntl(fd_in, F_SETFL, flags);
+    return ret;
+}
+
+/* Decompress the input stream; a code partially read when the input
+   would block is completed by the next call
+   Return:  one of defined lz78-level return codes
+ */
+static uint8_t decompress_stream(lz78_d* o, bit_file* in, FILE* out) {
+    dictionary* d_main;
+    uint32_t bits, written, code;
+    int ret;
 
     for (;;) {
         /* Optimization pointer (MUST be init every cycle) */
@@ -564,9 +1226,10 @@ uint8_t lz78_decompress(lz78_instance* lz78, int fd_in, int fd_out) {
         if (d_main->n_bytes) {
             written = 0;
             while (written != d_main->n_bytes) {
-                ret = fwrite(d_main->bytebuf + d_main->offset + written, 1,
-                        d_main->n_bytes - written, out);
-                if (ret == -1) {
+                written += fwrite(d_main->bytebuf + d_main->offset + written,
+                                  1, d_main->n_bytes - written, out);
+                if (written != d_main->n_bytes && ferror(out)) {
+                    clearerr(out);
                     d_main->offset += written;
                     d_main->n_bytes -= written;
                     if (errno == EAGAIN) {
@@ -576,25 +1239,28 @@ uint8_t lz78_decompress(lz78_instance* lz78, int fd_in, int fd_out) {
                         return LZ78_ERROR_WRITE;
                     }
                 }
-                written += ret;
             }
+            /* Written phrases are not written again on resumption */
+            d_main->n_bytes = 0;
         }
 
-        o->bitbuf = 0;
-        o->n_bits = 0;
         bits = bitlen(d_main->d_next);
 
-        if (bits > 0) {
-            ret = bit_read(in, (char*) &o->bitbuf, bits, 0);
+        if (bits > o->n_bits) {
+            ret = bit_read(in, (char*) &o->bitbuf + o->n_bits / 8,
+                           bits - o->n_bits, o->n_bits % 8);
             if (ret == -1)
                 return LZ78_ERROR_READ;
 
-            o->n_bits = ret;
+            o->n_bits += ret;
             if (bits != o->n_bits)
                 return LZ78_ERROR_EAGAIN;
         }
 
-        ret = decompress_code(o, o->bitbuf);
+        code = o->bitbuf;
+        o->bitbuf = 0;
+        o->n_bits = 0;
+        ret = decompress_code(o, code);
         if (ret < 0) {
             switch(ret) {
                 case -1:
@@ -604,6 +1270,16 @@ uint8_t lz78_decompress(lz78_instance* lz78, int fd_in, int fd_out) {
             }
         }
 
+        /* Everything preceding a flush point is written out at once */
+        if (o->flush) {
+            o->flush = 0;
+            if (bit_align(in) == -1)
+                return LZ78_ERROR_DECOMPRESS;
+            if (fflush(out) == EOF)
+                return (errno == EAGAIN) ? LZ78_ERROR_EAGAIN :
+                       LZ78_ERROR_WRITE;
+        }
+
         if (o->completed == 1) {
             fflush(out);
             return LZ78_SUCCESS;
@@ -611,6 +1287,2042 @@ uint8_t lz78_decompress(lz78_instance* lz78, int fd_in, int fd_out) {
     }
 }
 
+uint8_t lz78_decompress(lz78_instance* lz78, int fd_in, int fd_out) {
+    bit_file* in;
+    FILE* out;
+    lz78_d* o;
+    uint8_t ret;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+        return LZ78_ERROR_MODE;
+
+    o = (lz78_d*) &lz78->state;
+
+    /* A decompression suspended by LZ78_ERROR_EAGAIN resumes with the data
+       buffered by its input */
+    if (o->in != NULL) {
+        in = o->in;
+        out = o->out;
+    } else {
+        in = bit_open(fd_in, ACCESS_READ, B_SIZE_DEFAULT);
+        if (in == NULL)
+            return LZ78_ERROR_READ;
+
+        out = fdopen(fd_out, "w");
+        if (out == NULL)
+            return LZ78_ERROR_WRITE;
+    }
+
+    ret = decompress_stream(o, in, out);
+    o->in = (ret == LZ78_ERROR_EAGAIN) ? in : NULL;
+    o->out = (ret == LZ78_ERROR_EAGAIN) ? out : NULL;
+    return ret;
+}
+
+/* Allocate the rings and the chunks (of size bytes) of a link
+   Return:
+     0   success
+    -1   allocation failure
+ */
+static int pipe_link_init(pipe_link* l, uint32_t size) {
+    uint32_t i;
+
+    memset(l, 0, sizeof(pipe_link));
+    l->full = ring_new(PIPE_DEPTH);
+    l->empty = ring_new(PIPE_DEPTH);
+    if (l->full == NULL || l->empty == NULL)
+        return -1;
+
+    for (i = 0; i < PIPE_DEPTH; ++i) {
+        l->pool[i] = malloc(sizeof(chunk) + size);
+        if (l->pool[i] == NULL)
+            return -1;
+        ring_push(l->empty, l->pool[i]);
+    }
+    return 0;
+}
+
+/* Unblock both sides of a link */
+static void pipe_link_abort(pipe_link* l) {
+    if (l->full != NULL)
+        ring_abort(l->full);
+    if (l->empty != NULL)
+        ring_abort(l->empty);
+}
+
+static void pipe_link_destroy(pipe_link* l) {
+    uint32_t i;
+
+    ring_destroy(l->full);
+    ring_destroy(l->empty);
+    for (i = 0; i < PIPE_DEPTH; ++i)
+        free(l->pool[i]);
+}
+
+/* Read at least one byte, waiting on nonblocking descriptors
+   Return:  number of bytes read, 0 at EOF, -1 on error
+ */
+static int pipe_read(int fd, char* buf, uint32_t n) {
+    struct pollfd pfd;
+    int c;
+
+    for (;;) {
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        c = read(fd, buf, n);
+        if (c == -1 && errno == EAGAIN) {
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            poll(&pfd, 1, -1);
+        }
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        if (c != -1)
+            return c;
+        if (errno != EAGAIN && errno != EINTR)
+            return -1;
+    }
+}
+
+/* Write the whole buffer, waiting on nonblocking descriptors
+   Return:
+     0   success
+    -1   error
+ */
+static int pipe_write(int fd, const char* buf, uint32_t n) {
+    struct pollfd pfd;
+    int c;
+
+    while (n > 0) {
+        c = write(fd, buf, n);
+        if (c == -1) {
+            if (errno == EAGAIN) {
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+                poll(&pfd, 1, -1);
+            } else if (errno != EINTR) {
+                return -1;
+            }
+            continue;
+        }
+        buf += c;
+        n -= c;
+    }
+    return 0;
+}
+
+/* Reader stage: fill the chunks of the link with the input stream */
+static void* pipe_reader(void* arg) {
+    pipe_stage* s = (pipe_stage*) arg;
+    chunk* c;
+    int n;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    for (;;) {
+        c = ring_pop(s->link->empty);
+        if (c == NULL)
+            return NULL;
+
+        n = pipe_read(s->fd, c->data, PIPE_CHUNK);
+        if (n == -1)
+            s->ret = LZ78_ERROR_READ;
+        c->len = (n > 0) ? n : 0;
+        c->last = (n <= 0);
+
+        if (ring_push(s->link->full, c) == -1 || c->last)
+            return NULL;
+    }
+}
+
+/* Packer stage: pack the codes of the link into bytes and write them */
+static void* pipe_packer(void* arg) {
+    pipe_stage* s = (pipe_stage*) arg;
+    chunk* c;
+    uint32_t* codes;
+    uint8_t* buf;
+    bit_packer b;
+    uint32_t i;
+    uint8_t last;
+
+    /* Every code is at most 21 bits long */
+    buf = malloc(PIPE_CHUNK * 3 + 8);
+    b.acc = 0;
+    b.n_acc = 0;
+    if (buf == NULL) {
+        s->ret = LZ78_ERROR_PIPELINE;
+        pipe_link_abort(s->link);
+        return NULL;
+    }
+
+    for (;;) {
+        c = ring_pop(s->link->full);
+        if (c == NULL)
+            break;
+
+        codes = (uint32_t*) c->data;
+        b.p = buf;
+        for (i = 0; i < c->len; ++i)
+            pack_code(&b, codes[i], codes[i] >> 24);
+
+        /* Padding of the last byte */
+        last = c->last;
+        if (last)
+            pack_flush(&b);
+
+        if (pipe_write(s->fd, (char*) buf, b.p - buf) == -1) {
+            s->ret = LZ78_ERROR_WRITE;
+            pipe_link_abort(s->link);
+            break;
+        }
+
+        if (last || ring_push(s->link->empty, c) == -1)
+            break;
+    }
+
+    free(buf);
+    return NULL;
+}
+
+/* Writer stage: write the chunks of the link */
+static void* pipe_writer(void* arg) {
+    pipe_stage* s = (pipe_stage*) arg;
+    chunk* c;
+
+    for (;;) {
+        c = ring_pop(s->link->full);
+        if (c == NULL)
+            break;
+
+        if (pipe_write(s->fd, c->data, c->len) == -1) {
+            s->ret = LZ78_ERROR_WRITE;
+            pipe_link_abort(s->link);
+            break;
+        }
+
+        if (c->last || ring_push(s->link->empty, c) == -1)
+            break;
+    }
+    return NULL;
+}
+
+/* Append the pending code of the compressor to the chunk of codes,
+   handing the chunk to the packer when it is full
+   Return:  the chunk to be filled, NULL if the pipeline has been aborted
+ */
+static inline chunk* pipe_emit(lz78_c* o, chunk* c, pipe_link* l) {
+    ((uint32_t*) c->data)[c->len++] = o->bitbuf | (o->n_bits << 24);
+    o->n_bits = 0;
+
+    if (c->len < PIPE_CHUNK)
+        return c;
+
+    if (ring_push(l->full, c) == -1)
+        return NULL;
+    c = ring_pop(l->empty);
+    if (c != NULL) {
+        c->len = 0;
+        c->last = 0;
+    }
+    return c;
+}
+
+uint8_t lz78_compress_pipelined(lz78_instance* lz78, int fd_in, int fd_out) {
+    pipe_link l_in;
+    pipe_link l_out;
+    pipe_stage reader;
+    pipe_stage packer;
+    pthread_t t_reader;
+    pthread_t t_packer;
+    chunk* ci;
+    chunk* co = NULL;
+    lz78_c* o;
+    uint32_t i;
+    uint8_t ret = LZ78_ERROR_PIPELINE;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_COMPRESS)
+        return LZ78_ERROR_MODE;
+
+    memset(&l_out, 0, sizeof(pipe_link));
+    if (pipe_link_init(&l_in, PIPE_CHUNK) == -1 ||
+            pipe_link_init(&l_out, PIPE_CHUNK * sizeof(uint32_t)) == -1)
+        goto cleanup;
+
+    reader.fd = fd_in;
+    reader.link = &l_in;
+    reader.ret = LZ78_SUCCESS;
+    packer.fd = fd_out;
+    packer.link = &l_out;
+    packer.ret = LZ78_SUCCESS;
+
+    if (pthread_create(&t_reader, NULL, pipe_reader, &reader) != 0)
+        goto cleanup;
+    if (pthread_create(&t_packer, NULL, pipe_packer, &packer) != 0) {
+        pipe_link_abort(&l_in);
+        pthread_cancel(t_reader);
+        pthread_join(t_reader, NULL);
+        goto cleanup;
+    }
+
+    o = (lz78_c*)&lz78->state;
+
+    co = ring_pop(l_out.empty);
+    if (co == NULL)
+        goto abort;
+    co->len = 0;
+    co->last = 0;
+
+    /* Pending start code */
+    if (o->n_bits > 0 && (co = pipe_emit(o, co, &l_out)) == NULL)
+        goto abort;
+
+    for (;;) {
+        ci = ring_pop(l_in.full);
+        if (ci == NULL)
+            goto abort;
+
+        for (i = 0; i < ci->len; ++i) {
+            compress_byte(o, (uint8_t) ci->data[i]);
+            if (o->n_bits > 0 && (co = pipe_emit(o, co, &l_out)) == NULL)
+                goto abort;
+        }
+
+        if (ci->last)
+            break;
+
+        if (ring_push(l_in.empty, ci) == -1)
+            goto abort;
+
+        /* Hand the codes to the packer as soon as possible */
+        if (co->len > 0) {
+            if (ring_push(l_out.full, co) == -1)
+                goto abort;
+            co = ring_pop(l_out.empty);
+            if (co == NULL)
+                goto abort;
+            co->len = 0;
+            co->last = 0;
+        }
+    }
+
+    if (reader.ret != LZ78_SUCCESS)
+        goto abort;
+
+    while (o->completed == 0) {
+        compress_byte(o, EOF);
+        if (o->n_bits > 0 && (co = pipe_emit(o, co, &l_out)) == NULL)
+            goto abort;
+    }
+
+    co->last = 1;
+    if (ring_push(l_out.full, co) == -1)
+        goto abort;
+
+    pthread_join(t_reader, NULL);
+    pthread_join(t_packer, NULL);
+    ret = packer.ret;
+    goto cleanup;
+
+abort:
+    pipe_link_abort(&l_in);
+    pipe_link_abort(&l_out);
+    pthread_cancel(t_reader);
+    pthread_join(t_reader, NULL);
+    pthread_join(t_packer, NULL);
+    if (reader.ret != LZ78_SUCCESS)
+        ret = reader.ret;
+    else if (packer.ret != LZ78_SUCCESS)
+        ret = packer.ret;
+
+cleanup:
+    pipe_link_destroy(&l_in);
+    pipe_link_destroy(&l_out);
+    return ret;
+}
+
+/* Append the bytes of a phrase to the output chunks, handing the chunks
+   to the writer when they are full
+   Return:  the chunk to be filled, NULL if the pipeline has been aborted
+ */
+static inline chunk* pipe_output(chunk* c, const char* p, uint32_t n,
+                                 pipe_link* l) {
+    uint32_t k;
+
+    while (n > 0) {
+        k = PIPE_CHUNK - c->len;
+        k = (n < k) ? n : k;
+        memcpy(c->data + c->len, p, k);
+        c->len += k;
+        p += k;
+        n -= k;
+
+        if (c->len == PIPE_CHUNK) {
+            if (ring_push(l->full, c) == -1)
+                return NULL;
+            c = ring_pop(l->empty);
+            if (c == NULL)
+                return NULL;
+            c->len = 0;
+            c->last = 0;
+        }
+    }
+    return c;
+}
+
+uint8_t lz78_decompress_pipelined(lz78_instance* lz78, int fd_in, int fd_out) {
+    pipe_link l_in;
+    pipe_link l_out;
+    pipe_stage reader;
+    pipe_stage writer;
+    pthread_t t_reader;
+    pthread_t t_writer;
+    chunk* ci = NULL;
+    chunk* co = NULL;
+    lz78_d* o;
+    dictionary* d_main;
+    uint64_t acc = 0;
+    uint32_t n_acc = 0;
+    uint32_t pos = 0;
+    uint32_t bits;
+    uint32_t code;
+    uint8_t ret = LZ78_ERROR_PIPELINE;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+        return LZ78_ERROR_MODE;
+
+    memset(&l_out, 0, sizeof(pipe_link));
+    if (pipe_link_init(&l_in, PIPE_CHUNK) == -1 ||
+            pipe_link_init(&l_out, PIPE_CHUNK) == -1)
+        goto cleanup;
+
+    reader.fd = fd_in;
+    reader.link = &l_in;
+    reader.ret = LZ78_SUCCESS;
+    writer.fd = fd_out;
+    writer.link = &l_out;
+    writer.ret = LZ78_SUCCESS;
+
+    if (pthread_create(&t_reader, NULL, pipe_reader, &reader) != 0)
+        goto cleanup;
+    if (pthread_create(&t_writer, NULL, pipe_writer, &writer) != 0) {
+        pipe_link_abort(&l_in);
+        pthread_cancel(t_reader);
+        pthread_join(t_reader, NULL);
+        goto cleanup;
+    }
+
+    o = (lz78_d*) &lz78->state;
+
+    co = ring_pop(l_out.empty);
+    if (co == NULL)
+        goto abort;
+    co->len = 0;
+    co->last = 0;
+
+    for (;;) {
+        /* The width of the next code depends on the state of the
+           dictionaries, so codes are extracted by this stage */
+        d_main = o->main;
+        bits = bitlen(d_main->d_next);
+        while (n_acc < bits) {
+            if (ci == NULL || pos == ci->len) {
+                if (ci != NULL) {
+                    if (ci->last) {
+                        ret = (reader.ret != LZ78_SUCCESS) ?
+                                reader.ret : LZ78_ERROR_DECOMPRESS;
+                        goto abort;
+                    }
+                    if (ring_push(l_in.empty, ci) == -1)
+                        goto abort;
+                }
+
+                /* Hand the output to the writer before waiting */
+                if (co->len > 0) {
+                    if (ring_push(l_out.full, co) == -1)
+                        goto abort;
+                    co = ring_pop(l_out.empty);
+                    if (co == NULL)
+                        goto abort;
+                    co->len = 0;
+                    co->last = 0;
+                }
+
+                ci = ring_pop(l_in.full);
+                if (ci == NULL)
+                    goto abort;
+                pos = 0;
+                continue;
+            }
+            acc |= (uint64_t)(uint8_t) ci->data[pos++] << n_acc;
+            n_acc += 8;
+        }
+
+        code = acc & ((1 << bits) - 1);
+        acc >>= bits;
+        n_acc -= bits;
+
+        switch (decompress_code(o, code)) {
+            case -1:
+                ret = LZ78_ERROR_DICTIONARY;
+                goto abort;
+            case -2:
+                ret = LZ78_ERROR_DECOMPRESS;
+                goto abort;
+        }
+
+        /* The output is handed to the writer while waiting for input */
+        if (o->flush) {
+            o->flush = 0;
+            acc >>= n_acc % 8;
+            n_acc -= n_acc % 8;
+        }
+
+        if (o->completed == 1)
+            break;
+
+        d_main = o->main;
+        if (d_main->n_bytes) {
+            co = pipe_output(co, d_main->bytebuf + d_main->offset,
+                             d_main->n_bytes, &l_out);
+            if (co == NULL)
+                goto abort;
+            d_main->n_bytes = 0;
+        }
+    }
+
+    co->last = 1;
+    if (ring_push(l_out.full, co) == -1)
+        goto abort;
+
+    /* The reader could be waiting for input following the stream */
+    pipe_link_abort(&l_in);
+    pthread_cancel(t_reader);
+    pthread_join(t_reader, NULL);
+    pthread_join(t_writer, NULL);
+    ret = writer.ret;
+    goto cleanup;
+
+abort:
+    pipe_link_abort(&l_in);
+    pipe_link_abort(&l_out);
+    pthread_cancel(t_reader);
+    pthread_join(t_reader, NULL);
+    pthread_join(t_writer, NULL);
+    if (writer.ret != LZ78_SUCCESS)
+        ret = writer.ret;
+
+cleanup:
+    pipe_link_destroy(&l_in);
+    pipe_link_destroy(&l_out);
+    return ret;
+}
+
+void lz78_reset(lz78_instance* lz78) {
+    lz78_c* c;
+    lz78_d* d;
+
+    if (lz78 == NULL)
+        return;
+
+    switch (lz78->mode) {
+        case LZ78_MODE_COMPRESS:
+            c = (lz78_c*)&lz78->state;
+            c->completed = 0;
+            ht_dictionary_reset(c->main);
+            ht_dictionary_reset(c->secondary);
+            c->half = -1;
+            c->flush = FLUSH_NONE;
+            c->flushed = 0;
+            c->lines = 0;
+            c->dirty = 0;
+            c->stop = 0;
+            /* A suspended compression is abandoned */
+            c->in = NULL;
+            c->out = NULL;
+            /* The start code tells the decoder the alphabet */
+            c->bitbuf = (c->width == 1) ? DICT_CODE_START(ALPHABET_BYTE) :
+                        DICT_CODE_SIZE(ALPHABET_BYTE);
+            c->n_bits = bitlen(DICT_SIZE_MIN);
+            c->main->cur_node = DICT_CODE_START(c->alphabet);
+            break;
+
+        case LZ78_MODE_DECOMPRESS:
+            d = (lz78_d*)&lz78->state;
+            d->completed = 0;
+            d->alphabet = 0;
+            d->tail = 0;
+            d->flush = 0;
+            d->swaps = 0;
+            d->bitbuf = 0;
+            d->n_bits = 0;
+            d->in = NULL;
+            d->out = NULL;
+            if (d->main == NULL)
+                d->main = dictionary_new(DICT_SIZE_MIN, 1);
+            if (d->main != NULL) {
+                dictionary_reset(d->main);
+                d->main->n_bytes = 0;
+                /* The start code belongs to the byte alphabet whatever the
+                   alphabet of the previous stream */
+                d->main->d_next = DICT_SIZE_MIN;
+            }
+            break;
+    }
+}
+
+uint8_t lz78_set(lz78_instance* lz78, uint8_t option, uint32_t value) {
+    ht_dictionary* d_main;
+    ht_dictionary* d_sec;
+    lz78_c* c;
+    uint8_t width;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_COMPRESS)
+        return LZ78_ERROR_MODE;
+    c = (lz78_c*)&lz78->state;
+
+    switch (option) {
+        case LZ78_OPTION_ALPHABET:
+            if (value != LZ78_ALPHABET_BYTE && value != LZ78_ALPHABET_WIDE)
+                return LZ78_ERROR_INITIALIZATION;
+            width = value / 8;
+            if (width == c->width)
+                break;
+
+            /* The root of the dictionaries holds all the symbols */
+            d_main = ht_dictionary_new(c->d_size, width);
+            d_sec = ht_dictionary_new(c->d_size, width);
+            if (d_main == NULL || d_sec == NULL) {
+                ht_dictionary_destroy(d_main);
+                ht_dictionary_destroy(d_sec);
+                return LZ78_ERROR_DICTIONARY;
+            }
+            ht_dictionary_destroy(c->main);
+            ht_dictionary_destroy(c->secondary);
+            c->main = d_main;
+            c->secondary = d_sec;
+            c->width = width;
+            c->alphabet = (width == 1) ? ALPHABET_BYTE : ALPHABET_WIDE;
+            lz78_reset(lz78);
+            break;
+
+        case LZ78_OPTION_FLUSH_MS:
+            c->flush_ms = value;
+            break;
+
+        case LZ78_OPTION_FLUSH_LINES:
+            c->flush_lines = value;
+            break;
+
+        case LZ78_OPTION_FOLLOW:
+            c->follow = (value != 0);
+            if (c->follow && c->flush_ms == 0)
+                c->flush_ms = FOLLOW_FLUSH_MS;
+            break;
+
+        default:
+            return LZ78_ERROR_MODE;
+    }
+    return LZ78_SUCCESS;
+}
+
+uint8_t lz78_flush(lz78_instance* lz78) {
+    lz78_c* c;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_COMPRESS)
+        return LZ78_ERROR_MODE;
+
+    c = (lz78_c*)&lz78->state;
+    if (c->flush == FLUSH_NONE)
+        c->flush = FLUSH_PHRASE;
+    return LZ78_SUCCESS;
+}
+
+uint8_t lz78_stop(lz78_instance* lz78) {
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_COMPRESS)
+        return LZ78_ERROR_MODE;
+
+    ((lz78_c*)&lz78->state)->stop = 1;
+    return LZ78_SUCCESS;
+}
+
+uint8_t lz78_prime(lz78_instance* lz78, const char* data, uint32_t n) {
+    lz78_c* c;
+    lz78_d* d;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    switch (lz78->mode) {
+        case LZ78_MODE_COMPRESS:
+            c = (lz78_c*)&lz78->state;
+            c->prime = data;
+            c->n_prime = n;
+            break;
+
+        case LZ78_MODE_DECOMPRESS:
+            d = (lz78_d*)&lz78->state;
+            d->prime = data;
+            d->n_prime = n;
+            break;
+
+        default:
+            return LZ78_ERROR_MODE;
+    }
+    return LZ78_SUCCESS;
+}
+
+uint8_t lz78_compress_mem(lz78_instance* lz78, const char* in, uint32_t n_in,
+                          char* out, uint32_t* n_out) {
+    bit_packer b;
+    lz78_c* o;
+    uint32_t i;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_COMPRESS)
+        return LZ78_ERROR_MODE;
+
+    lz78_reset(lz78);
+    o = (lz78_c*)&lz78->state;
+
+    b.p = (uint8_t*) out;
+    b.acc = 0;
+    b.n_acc = 0;
+
+    /* Pending start code */
+    pack_code(&b, o->bitbuf, o->n_bits);
+    o->n_bits = 0;
+
+    for (i = 0; i < n_in; ++i) {
+        compress_byte(o, (uint8_t) in[i]);
+        if (o->n_bits > 0) {
+            pack_code(&b, o->bitbuf, o->n_bits);
+            o->n_bits = 0;
+        }
+    }
+
+    while (o->completed == 0) {
+        compress_byte(o, EOF);
+        if (o->n_bits > 0) {
+            pack_code(&b, o->bitbuf, o->n_bits);
+            o->n_bits = 0;
+        }
+    }
+
+    pack_flush(&b);
+    *n_out = (char*) b.p - out;
+    return LZ78_SUCCESS;
+}
+
+uint8_t lz78_decompress_mem(lz78_instance* lz78, const char* in, uint32_t n_in,
+                            char* out, uint32_t* n_out) {
+    bit_unpacker b;
+    lz78_d* o;
+    dictionary* d_main;
+    uint32_t code;
+    uint32_t size = 0;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+        return LZ78_ERROR_MODE;
+
+    lz78_reset(lz78);
+    o = (lz78_d*)&lz78->state;
+    if (o->main == NULL)
+        return LZ78_ERROR_DICTIONARY;
+
+    b.p = (const uint8_t*) in;
+    b.end = b.p + n_in;
+    b.acc = 0;
+    b.n_acc = 0;
+
+    for (;;) {
+        d_main = o->main;
+        if (unpack_code(&b, bitlen(d_main->d_next), &code) == -1)
+            return LZ78_ERROR_DECOMPRESS;
+
+        switch (decompress_code(o, code)) {
+            case -1:
+                return LZ78_ERROR_DICTIONARY;
+            case -2:
+                return LZ78_ERROR_DECOMPRESS;
+        }
+
+        if (o->flush) {
+            o->flush = 0;
+            b.acc >>= b.n_acc % 8;
+            b.n_acc -= b.n_acc % 8;
+        }
+
+        if (o->completed == 1)
+            break;
+
+        d_main = o->main;
+        if (d_main->n_bytes) {
+            if (d_main->n_bytes > *n_out - size)
+                return LZ78_ERROR_DECOMPRESS;
+            memcpy(out + size, d_main->bytebuf + d_main->offset,
+                   d_main->n_bytes);
+            size += d_main->n_bytes;
+            d_main->n_bytes = 0;
+        }
+    }
+
+    *n_out = size;
+    return LZ78_SUCCESS;
+}
+
+/* Return the output buffer k of the iovec functions, allocated on first use
+   Return:  the buffer, NULL on failure
+ */
+static uint8_t* iov_segment(lz78_instance* lz78, uint32_t k) {
+    struct iovec* tmp;
+
+    if (k < lz78->n_segments)
+        return lz78->segments[k].iov_base;
+    tmp = realloc(lz78->segments, (k + 1) * sizeof(struct iovec));
+    if (tmp == NULL)
+        return NULL;
+    lz78->segments = tmp;
+    tmp[k].iov_base = malloc(IOV_SEGMENT);
+    if (tmp[k].iov_base == NULL)
+        return NULL;
+    lz78->n_segments = k + 1;
+    return tmp[k].iov_base;
+}
+
+/* Move the packer to the next output buffer when the current one (k) cannot
+   hold another code
+   Return:  0 on success, -1 on failure
+ */
+static int iov_pack_next(lz78_instance* lz78, bit_packer* b, uint32_t* k) {
+    uint8_t* seg = lz78->segments[*k].iov_base;
+
+    if (b->p + 8 <= seg + IOV_SEGMENT)
+        return 0;
+    lz78->segments[*k].iov_len = b->p - seg;
+    seg = iov_segment(lz78, ++(*k));
+    if (seg == NULL)
+        return -1;
+    b->p = seg;
+    return 0;
+}
+
+uint8_t lz78_compress_iov(lz78_instance* lz78, const struct iovec* iov,
+                          int iovcnt, const struct iovec** out, int* n_out) {
+    bit_packer b;
+    lz78_c* o;
+    const uint8_t* p;
+    uint32_t k = 0;
+    size_t i;
+    int j;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_COMPRESS)
+        return LZ78_ERROR_MODE;
+
+    lz78_reset(lz78);
+    o = (lz78_c*)&lz78->state;
+
+    b.p = iov_segment(lz78, 0);
+    if (b.p == NULL)
+        return LZ78_ERROR_DICTIONARY;
+    b.acc = 0;
+    b.n_acc = 0;
+
+    /* Pending start code */
+    pack_code(&b, o->bitbuf, o->n_bits);
+    o->n_bits = 0;
+
+    for (j = 0; j < iovcnt; ++j) {
+        p = (const uint8_t*) iov[j].iov_base;
+        for (i = 0; i < iov[j].iov_len; ++i) {
+            compress_byte(o, p[i]);
+            if (o->n_bits > 0) {
+                pack_code(&b, o->bitbuf, o->n_bits);
+                o->n_bits = 0;
+                if (iov_pack_next(lz78, &b, &k) == -1)
+                    return LZ78_ERROR_DICTIONARY;
+            }
+        }
+    }
+
+    while (o->completed == 0) {
+        compress_byte(o, EOF);
+        if (o->n_bits > 0) {
+            pack_code(&b, o->bitbuf, o->n_bits);
+            o->n_bits = 0;
+            if (iov_pack_next(lz78, &b, &k) == -1)
+                return LZ78_ERROR_DICTIONARY;
+        }
+    }
+
+    pack_flush(&b);
+    lz78->segments[k].iov_len = b.p - (uint8_t*) lz78->segments[k].iov_base;
+    *out = lz78->segments;
+    *n_out = k + 1;
+    return LZ78_SUCCESS;
+}
+
+uint8_t lz78_decompress_iov(lz78_instance* lz78, const struct iovec* iov,
+                            int iovcnt, const struct iovec** out,
+                            int* n_out) {
+    bit_unpacker b;
+    lz78_d* o;
+    dictionary* d_main;
+    uint8_t* seg;
+    uint32_t code;
+    uint32_t used = 0;
+    uint32_t k = 0;
+    uint32_t n;
+    int j = 0;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+        return LZ78_ERROR_MODE;
+
+    lz78_reset(lz78);
+    o = (lz78_d*)&lz78->state;
+    if (o->main == NULL)
+        return LZ78_ERROR_DICTIONARY;
+
+    seg = iov_segment(lz78, 0);
+    if (seg == NULL)
+        return LZ78_ERROR_DICTIONARY;
+    b.p = b.end = NULL;
+    b.acc = 0;
+    b.n_acc = 0;
+
+    for (;;) {
+        /* The codes continue in the next input buffer */
+        d_main = o->main;
+        if (unpack_code(&b, bitlen(d_main->d_next), &code) == -1) {
+            if (j == iovcnt)
+                return LZ78_ERROR_DECOMPRESS;
+            b.p = (const uint8_t*) iov[j].iov_base;
+            b.end = b.p + iov[j].iov_len;
+            ++j;
+            continue;
+        }
+
+        switch (decompress_code(o, code)) {
+            case -1:
+                return LZ78_ERROR_DICTIONARY;
+            case -2:
+                return LZ78_ERROR_DECOMPRESS;
+        }
+
+        if (o->flush) {
+            o->flush = 0;
+            b.acc >>= b.n_acc % 8;
+            b.n_acc -= b.n_acc % 8;
+        }
+
+        if (o->completed == 1)
+            break;
+
+        /* Phrases may span several output buffers */
+        d_main = o->main;
+        while (d_main->n_bytes > 0) {
+            if (used == IOV_SEGMENT) {
+                lz78->segments[k].iov_len = used;
+                seg = iov_segment(lz78, ++k);
+                if (seg == NULL)
+                    return LZ78_ERROR_DICTIONARY;
+                used = 0;
+            }
+            n = IOV_SEGMENT - used;
+            n = (d_main->n_bytes < n) ? d_main->n_bytes : n;
+            memcpy(seg + used, d_main->bytebuf + d_main->offset, n);
+            used += n;
+            d_main->offset += n;
+            d_main->n_bytes -= n;
+        }
+    }
+
+    lz78->segments[k].iov_len = used;
+    *out = lz78->segments;
+    *n_out = k + (used > 0);
+    return LZ78_SUCCESS;
+}
+
+uint8_t lz78_phrases(lz78_instance* lz78, const char* in, uint32_t n_in) {
+    lz78_d* o;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+        return LZ78_ERROR_MODE;
+
+    lz78_reset(lz78);
+    o = (lz78_d*)&lz78->state;
+    if (o->main == NULL)
+        return LZ78_ERROR_DICTIONARY;
+
+    o->source.p = (const uint8_t*) in;
+    o->source.end = o->source.p + n_in;
+    o->source.acc = 0;
+    o->source.n_acc = 0;
+    return LZ78_SUCCESS;
+}
+
+uint8_t lz78_next_phrase(lz78_instance* lz78, const char** data,
+                         uint32_t* n) {
+    lz78_d* o;
+    dictionary* d_main;
+    uint32_t code;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+        return LZ78_ERROR_MODE;
+
+    o = (lz78_d*)&lz78->state;
+    *data = NULL;
+    *n = 0;
+
+    /* Control codes yield nothing: codes are decoded up to a phrase */
+    while (o->completed == 0) {
+        d_main = o->main;
+        if (unpack_code(&o->source, bitlen(d_main->d_next), &code) == -1)
+            return LZ78_ERROR_DECOMPRESS;
+
+        switch (decompress_code(o, code)) {
+            case -1:
+                return LZ78_ERROR_DICTIONARY;
+            case -2:
+                return LZ78_ERROR_DECOMPRESS;
+        }
+
+        if (o->flush) {
+            o->flush = 0;
+            o->source.acc >>= o->source.n_acc % 8;
+            o->source.n_acc -= o->source.n_acc % 8;
+        }
+
+        /* The phrase is handed out from the buffer of the dictionary */
+        d_main = o->main;
+        if (o->completed == 0 && d_main->n_bytes > 0) {
+            *data = d_main->bytebuf + d_main->offset;
+            *n = d_main->n_bytes;
+            d_main->n_bytes = 0;
+            return LZ78_SUCCESS;
+        }
+    }
+    return LZ78_SUCCESS;
+}
+
+/* Store the n lower bytes of v (little endian) */
+static inline void put_le(char* p, uint64_t v, uint8_t n) {
+    while (n-- > 0) {
+        *p++ = v;
+        v >>= 8;
+    }
+}
+
+/* Load n bytes stored by put_le() */
+static inline uint64_t get_le(const char* p, uint8_t n) {
+    uint64_t v = 0;
+
+    while (n-- > 0)
+        v = (v << 8) | (uint8_t) p[n];
+    return v;
+}
+
+/* Read a code of a stream read from a file and decode it, counting in pos
+   the bits consumed (the padding of flush points included)
+   Return:  one of defined lz78-level return codes
+ */
+static uint8_t decode_next(lz78_d* o, bit_file* in, uint64_t* pos) {
+    uint32_t bits = bitlen(o->main->d_next);
+    uint32_t pad;
+    int ret;
+
+    o->bitbuf = 0;
+    ret = bit_read(in, (char*) &o->bitbuf, bits, 0);
+    if (ret == -1)
+        return LZ78_ERROR_READ;
+    if ((uint32_t) ret != bits)
+        return LZ78_ERROR_DECOMPRESS;
+    *pos += bits;
+
+    switch (decompress_code(o, o->bitbuf)) {
+        case -1:
+            return LZ78_ERROR_DICTIONARY;
+        case -2:
+            return LZ78_ERROR_DECOMPRESS;
+    }
+
+    if (o->flush) {
+        o->flush = 0;
+        pad = (8 - *pos % 8) % 8;
+        if (pad > 0 && bit_read(in, (char*) &o->bitbuf, pad, 0) != (int) pad)
+            return LZ78_ERROR_DECOMPRESS;
+        *pos += pad;
+    }
+    return LZ78_SUCCESS;
+}
+
+/* Append to buf a checkpoint of the decoder, writing buf to fd when full
+   Return:  0 on success, -1 on failure
+ */
+static int index_checkpoint(lz78_d* o, int fd, char* buf, uint32_t* n,
+                            uint64_t offset, uint64_t pos) {
+    dictionary* d = o->main;
+    uint32_t size = 3 + d->width;
+    uint32_t i;
+
+    if (*n + INDEX_CHECKPOINT > INDEX_BUFFER) {
+        if (pipe_write(fd, buf, *n) == -1)
+            return -1;
+        *n = 0;
+    }
+    put_le(buf + *n, offset, 8);
+    put_le(buf + *n + 8, pos, 8);
+    put_le(buf + *n + 16, d->d_next - d->d_first, 4);
+    *n += INDEX_CHECKPOINT;
+
+    for (i = d->d_first; i < d->d_next; ++i) {
+        if (*n + size > INDEX_BUFFER) {
+            if (pipe_write(fd, buf, *n) == -1)
+                return -1;
+            *n = 0;
+        }
+        put_le(buf + *n, d->root[i].parent, 3);
+        put_le(buf + *n + 3, d->root[i].label, d->width);
+        *n += size;
+    }
+    return 0;
+}
+
+uint8_t lz78_index(lz78_instance* lz78, int fd_in, int fd_out,
+                   uint64_t interval) {
+    bit_file* in;
+    lz78_d* o;
+    char* buf;
+    uint64_t pos = 0;
+    uint64_t offset = 0;
+    uint64_t last = 0;
+    uint32_t start, size;
+    uint32_t swaps;
+    uint32_t n = 0;
+    int flags;
+    uint8_t ret;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+        return LZ78_ERROR_MODE;
+
+    lz78_reset(lz78);
+    o = (lz78_d*)&lz78->state;
+    if (o->main == NULL)
+        return LZ78_ERROR_DICTIONARY;
+    o->n_prime = 0;
+    if (interval == 0)
+        interval = LZ78_CHECKPOINT_DEFAULT;
+
+    /* Short reads are the end of the stream */
+    flags = fcntl(fd_in, F_GETFL);
+    if (flags == -1 || fcntl(fd_in, F_SETFL, flags & ~O_NONBLOCK) == -1)
+        return LZ78_ERROR_READ;
+
+    in = bit_open(fd_in, ACCESS_READ, B_SIZE_DEFAULT);
+    buf = malloc(INDEX_BUFFER);
+    if (in == NULL || buf == NULL) {
+        free(in);
+        free(buf);
+        fcntl(fd_in, F_SETFL, flags);
+        return (in == NULL) ? LZ78_ERROR_READ : LZ78_ERROR_DICTIONARY;
+    }
+
+    /* The start and size codes create the dictionaries: the first
+       checkpoint follows them */
+    ret = decode_next(o, in, &pos);
+    start = o->bitbuf;
+    if (ret == LZ78_SUCCESS)
+        ret = decode_next(o, in, &pos);
+    if (ret == LZ78_SUCCESS && (o->completed || o->secondary == NULL))
+        ret = LZ78_ERROR_DECOMPRESS;
+    /* The size code, as limited by the decoder */
+    size = o->main->d_size;
+
+    if (ret == LZ78_SUCCESS) {
+        memcpy(buf, INDEX_MAGIC, 4);
+        buf[4] = INDEX_VERSION;
+        buf[5] = o->main->width;
+        put_le(buf + 6, 0, 2);
+        put_le(buf + 8, start, 4);
+        put_le(buf + 12, size, 4);
+        n = INDEX_HEADER;
+        if (index_checkpoint(o, fd_out, buf, &n, offset, pos) == -1)
+            ret = LZ78_ERROR_WRITE;
+    }
+
+    /* A checkpoint at the first swap after every interval bytes, when the
+       main dictionary holds only the entries moved from the secondary */
+    while (ret == LZ78_SUCCESS) {
+        swaps = o->swaps;
+        ret = decode_next(o, in, &pos);
+        if (ret != LZ78_SUCCESS || o->completed)
+            break;
+        offset += o->main->n_bytes;
+        o->main->n_bytes = 0;
+
+        if (o->swaps != swaps && offset - last >= interval) {
+            last = offset;
+            if (index_checkpoint(o, fd_out, buf, &n, offset, pos) == -1)
+                ret = LZ78_ERROR_WRITE;
+        }
+    }
+
+    if (ret == LZ78_SUCCESS && pipe_write(fd_out, buf, n) == -1)
+        ret = LZ78_ERROR_WRITE;
+
+    /* The bit_file is released without closing the descriptor */
+    free(in);
+    free(buf);
+    fcntl(fd_in, F_SETFL, flags);
+    return ret;
+}
+
+/* Restore the decoder from the last checkpoint of the index preceding
+   offset (data is the data offset and pos the bit offset of the checkpoint)
+   Return:  one of defined lz78-level return codes
+ */
+static uint8_t index_restore(lz78_d* o, int fd, uint64_t offset,
+                             uint64_t* data, uint64_t* pos) {
+    char head[INDEX_CHECKPOINT];
+    char* buf;
+    dictionary* d;
+    uint64_t at = INDEX_HEADER;
+    uint64_t found = 0;
+    uint32_t count = 0;
+    uint32_t width, size;
+    uint32_t i, k, n;
+    uint8_t ret = LZ78_SUCCESS;
+
+    if (pread(fd, head, INDEX_HEADER, 0) != INDEX_HEADER ||
+            memcmp(head, INDEX_MAGIC, 4) != 0 || head[4] != INDEX_VERSION ||
+            (head[5] != 1 && head[5] != 2))
+        return LZ78_ERROR_DECOMPRESS;
+    width = head[5];
+    size = 3 + width;
+
+    /* The start and size codes of the stream create the dictionaries */
+    if (decompress_code(o, get_le(head + 8, 4)) != 0 ||
+            decompress_code(o, get_le(head + 12, 4)) != 0 ||
+            o->secondary == NULL || o->main->width != width)
+        return LZ78_ERROR_DECOMPRESS;
+    d = o->main;
+
+    /* Checkpoints are sorted by offset, the first one is at 0 */
+    for (;;) {
+        if (pread(fd, head, INDEX_CHECKPOINT, at) != INDEX_CHECKPOINT ||
+                get_le(head, 8) > offset)
+            break;
+        *data = get_le(head, 8);
+        *pos = get_le(head + 8, 8);
+        count = get_le(head + 16, 4);
+        found = at + INDEX_CHECKPOINT;
+        at = found + (uint64_t) count * size;
+    }
+    if (found == 0 || count >= d->d_size - d->d_first)
+        return LZ78_ERROR_DECOMPRESS;
+
+    buf = malloc(INDEX_BUFFER);
+    if (buf == NULL)
+        return LZ78_ERROR_DICTIONARY;
+
+    /* Parents precede their children, labels are symbols */
+    for (i = 0; ret == LZ78_SUCCESS && i < count; i += n) {
+        n = (count - i < INDEX_BUFFER / size) ? count - i : INDEX_BUFFER / size;
+        if (pread(fd, buf, n * size, found + (uint64_t) i * size) !=
+                (ssize_t) (n * size)) {
+            ret = LZ78_ERROR_DECOMPRESS;
+            break;
+        }
+        for (k = 0; k < n; ++k) {
+            d->root[d->d_first + i + k].parent = get_le(buf + k * size, 3);
+            d->root[d->d_first + i + k].label = get_le(buf + k * size + 3,
+                                                       width);
+            if (d->root[d->d_first + i + k].parent >= d->d_first + i + k)
+                ret = LZ78_ERROR_DECOMPRESS;
+        }
+    }
+    free(buf);
+
+    d->d_min = d->d_first + count;
+    d->d_next = d->d_first + count;
+    return ret;
+}
+
+uint8_t lz78_decompress_range(lz78_instance* lz78, int fd_in, int fd_index,
+                              uint64_t offset, uint64_t n, int fd_out) {
+    bit_file* in = NULL;
+    lz78_d* o;
+    dictionary* d;
+    char* buf;
+    uint64_t data = 0;
+    uint64_t pos = 0;
+    uint64_t end = (n > UINT64_MAX - offset) ? UINT64_MAX : offset + n;
+    uint32_t skip, len;
+    uint32_t size = 0;
+    int flags;
+    uint8_t ret;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+        return LZ78_ERROR_MODE;
+
+    lz78_reset(lz78);
+    o = (lz78_d*)&lz78->state;
+    if (o->main == NULL)
+        return LZ78_ERROR_DICTIONARY;
+    o->n_prime = 0;
+
+    buf = malloc(INDEX_BUFFER);
+    if (buf == NULL)
+        return LZ78_ERROR_DICTIONARY;
+
+    flags = fcntl(fd_in, F_GETFL);
+    if (flags == -1 || fcntl(fd_in, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+        free(buf);
+        return LZ78_ERROR_READ;
+    }
+
+    /* Without an index the stream is decoded from its start */
+    ret = LZ78_SUCCESS;
+    if (fd_index != -1)
+        ret = index_restore(o, fd_index, offset, &data, &pos);
+    if (ret == LZ78_SUCCESS &&
+            lseek(fd_in, pos / 8, SEEK_SET) != (off_t) (pos / 8))
+        ret = LZ78_ERROR_READ;
+    if (ret == LZ78_SUCCESS &&
+            (in = bit_open(fd_in, ACCESS_READ, B_SIZE_DEFAULT)) == NULL)
+        ret = LZ78_ERROR_READ;
+    if (ret == LZ78_SUCCESS && pos % 8 > 0 &&
+            bit_read(in, (char*) &o->bitbuf, pos % 8, 0) != (int) (pos % 8))
+        ret = LZ78_ERROR_DECOMPRESS;
+
+    while (ret == LZ78_SUCCESS && data < end) {
+        ret = decode_next(o, in, &pos);
+        if (ret != LZ78_SUCCESS || o->completed)
+            break;
+
+        /* The part of the phrase inside the range */
+        d = o->main;
+        if (data + d->n_bytes > offset) {
+            skip = (data < offset) ? offset - data : 0;
+            len = d->n_bytes - skip;
+            if (len > end - data - skip)
+                len = end - data - skip;
+            if (size + len > INDEX_BUFFER) {
+                if (pipe_write(fd_out, buf, size) == -1)
+                    ret = LZ78_ERROR_WRITE;
+                size = 0;
+            }
+            /* Phrases longer than the buffer are written at once */
+            if (len > INDEX_BUFFER) {
+                if (pipe_write(fd_out, d->bytebuf + d->offset + skip,
+                               len) == -1)
+                    ret = LZ78_ERROR_WRITE;
+            } else {
+                memcpy(buf + size, d->bytebuf + d->offset + skip, len);
+                size += len;
+            }
+        }
+        data += d->n_bytes;
+        d->n_bytes = 0;
+    }
+
+    if (ret == LZ78_SUCCESS && pipe_write(fd_out, buf, size) == -1)
+        ret = LZ78_ERROR_WRITE;
+
+    /* The bit_file is released without closing the descriptor */
+    free(in);
+    free(buf);
+    fcntl(fd_in, F_SETFL, flags);
+    return ret;
+}
+
+/* Build the matcher (KMP automaton and failure chains) and the suffix
+   automaton of the pattern, and the entries of the single bytes */
+static void grep_init(grep* g) {
+    const uint8_t* p = (const uint8_t*) g->pattern;
+    uint32_t m = g->m;
+    uint32_t x = 0;
+    uint32_t q, c;
+    uint32_t n = 1;
+    uint32_t last = 0;
+    uint32_t cur, s, t, clone;
+    grep_entry* e;
+
+    /* delta[q][c]: longest prefix of P suffix of P[1..q]c; x is the state
+       of the longest proper border of P[1..q] */
+    g->delta[0][p[0]] = 1;
+    for (q = 1; q <= m; ++q) {
+        memcpy(g->delta[q], g->delta[x], 256);
+        g->chain[q] = g->chain[x] | ((q < m) ? (uint64_t) 1 << q : 0);
+        if (q < m) {
+            g->delta[q][p[q]] = q + 1;
+            x = g->delta[x][p[q]];
+        }
+    }
+
+    /* Suffix automaton (state 0 is the empty string, never a target) */
+    for (q = 0; q < m; ++q) {
+        c = p[q];
+        cur = n++;
+        g->length[cur] = q + 1;
+        g->end[cur] = q;
+        for (s = last; !g->next[s][c]; s = g->link[s]) {
+            g->next[s][c] = cur;
+            if (s == 0)
+                break;
+        }
+        if (g->next[s][c] == cur) {
+            g->link[cur] = 0;
+        } else if (g->length[s] + 1 == g->length[g->next[s][c]]) {
+            g->link[cur] = g->next[s][c];
+        } else {
+            t = g->next[s][c];
+            clone = n++;
+            memcpy(g->next[clone], g->next[t], 256);
+            g->length[clone] = g->length[s] + 1;
+            g->link[clone] = g->link[t];
+            g->end[clone] = g->end[t];
+            for (;;) {
+                if (g->next[s][c] != t)
+                    break;
+                g->next[s][c] = clone;
+                if (s == 0)
+                    break;
+                s = g->link[s];
+            }
+            g->link[t] = clone;
+            g->link[cur] = clone;
+        }
+        last = cur;
+    }
+    for (s = last; s != 0; s = g->link[s])
+        g->terminal[s] = 1;
+
+    for (c = 0; c < 256; ++c) {
+        e = &g->entries[c];
+        e->first = c;
+        e->state = g->delta[0][c];
+        e->factor = g->next[0][c];
+        e->len = 1;
+        e->flags = ((e->state == m) ? GREP_MATCH : 0) |
+                   ((c == '\n') ? GREP_NEWLINE : 0);
+        e->prefixes = (e->factor && g->terminal[e->factor] && m > 1) ?
+                      (uint64_t) 1 << (m - 1) : 0;
+    }
+}
+
+/* Compute the entry of the search of a complete dictionary entry from the
+   one of its parent */
+static inline void grep_entry_fill(grep* g, dictionary* d, uint32_t code) {
+    grep_entry* e = &g->entries[code];
+    grep_entry* pe = &g->entries[d->root[code].parent];
+    uint8_t c = d->root[code].label;
+
+    e->first = pe->first;
+    e->state = g->delta[pe->state][c];
+    e->flags = pe->flags | ((e->state == g->m) ? GREP_MATCH : 0) |
+               ((c == '\n') ? GREP_NEWLINE : 0);
+    e->factor = pe->factor ? g->next[pe->factor][c] : 0;
+    e->len = e->factor ? pe->len + 1 : 0;
+    e->prefixes = pe->prefixes;
+    if (e->factor && g->terminal[e->factor] && e->len < g->m)
+        e->prefixes |= (uint64_t) 1 << (g->m - e->len);
+}
+
+/* Return the matcher state after the phrase of the entry from state q: the
+   state from 0 unless the phrase is a factor of P, read from P itself */
+static inline uint8_t grep_jump(grep* g, grep_entry* e, uint8_t q) {
+    const uint8_t* p;
+    uint32_t i;
+
+    if (!e->factor)
+        return e->state;
+    p = (const uint8_t*) g->pattern + g->end[e->factor] + 1 - e->len;
+    for (i = 0; i < e->len; ++i)
+        q = g->delta[q][p[i]];
+    return q;
+}
+
+/* Write out the buffer of the matching lines
+   Return:  0 on success, -1 on failure
+ */
+static int grep_flush(grep* g) {
+    if (pipe_write(g->fd_out, g->out, g->n_out) == -1)
+        return -1;
+    g->n_out = 0;
+    return 0;
+}
+
+/* Append n bytes to the buffer of the matching lines
+   Return:  0 on success, -1 on failure
+ */
+static int grep_write(grep* g, const char* p, size_t n) {
+    if (g->n_out + n > INDEX_BUFFER && grep_flush(g) == -1)
+        return -1;
+    if (n > INDEX_BUFFER)
+        return pipe_write(g->fd_out, p, n);
+    memcpy(g->out + g->n_out, p, n);
+    g->n_out += n;
+    return 0;
+}
+
+/* Expand the codes of the current line after its expanded part (the first
+   code from its last newline if it ends the previous line)
+   Return:  0 on success, -1 on failure
+ */
+static int grep_expand(grep* g, dictionary* d) {
+    uint32_t i, j, p;
+    char* tmp;
+    char* s;
+
+    for (i = 0; i < g->n_codes; ++i) {
+        j = d->d_size;
+        p = g->codes[i];
+        while (1) {
+            d->bytebuf[--j] = d->root[p].label;
+            if (p < d->d_first)
+                break;
+            p = d->root[p].parent;
+        }
+        s = d->bytebuf + j;
+        if (i == 0 && g->skip) {
+            s = memrchr(s, '\n', d->d_size - j) + 1;
+            j = s - d->bytebuf;
+        }
+
+        if (g->n_line + d->d_size - j > g->line_size) {
+            tmp = realloc(g->line, 2 * (g->n_line + d->d_size - j));
+            if (tmp == NULL)
+                return -1;
+            g->line = tmp;
+            g->line_size = 2 * (g->n_line + d->d_size - j);
+        }
+        memcpy(g->line + g->n_line, s, d->d_size - j);
+        g->n_line += d->d_size - j;
+    }
+    g->n_codes = 0;
+    g->skip = 0;
+    return 0;
+}
+
+/* Write the lines of the expanded line which contain P, keeping the part
+   following the last newline (all of it at the end of the stream)
+   Return:  0 on success, -1 on failure
+ */
+static int grep_lines(grep* g, uint8_t last) {
+    char* p = g->line;
+    char* end = g->line + g->n_line;
+    char* q;
+
+    while (p < end) {
+        q = memchr(p, '\n', end - p);
+        if (q == NULL && !last)
+            break;
+        q = (q == NULL) ? end : q + 1;
+        if (memmem(p, q - p, g->pattern, g->m) != NULL) {
+            if (grep_write(g, p, q - p) == -1)
+                return -1;
+            if (q[-1] != '\n' && grep_write(g, "\n", 1) == -1)
+                return -1;
+        }
+        p = q;
+    }
+
+    /* The rest of a line matches if P is inside it already */
+    g->n_line = end - p;
+    memmove(g->line, p, g->n_line);
+    g->pending = (memmem(g->line, g->n_line, g->pattern, g->m) != NULL);
+    return 0;
+}
+
+/* Search P in the phrase of a code (instead of its bytes) and update the
+   dictionaries as decompress_code() does
+   Return:  0 on success, -1 on memory or output failure, -2 on bad code
+ */
+static int grep_code(lz78_d* o, grep* g, uint32_t code) {
+    dictionary* d = o->main;
+    ht_dictionary* d_sec = o->secondary;
+    grep_entry* e;
+    uint32_t* tmp;
+    uint32_t i;
+
+    if (code >= d->d_next)
+        return -2;
+
+    /* The phrase completes the last entry with its first byte */
+    if (d->d_next > d->d_min) {
+        d->root[d->d_next - 1].label = g->entries[code].first;
+        grep_entry_fill(g, d, d->d_next - 1);
+    }
+
+    /* P ends inside the phrase, starting either in it or in the previous
+       phrases at a state of the failure chain */
+    e = &g->entries[code];
+    if ((e->flags & GREP_MATCH) || (g->chain[g->state] & e->prefixes))
+        g->pending = 1;
+    g->state = grep_jump(g, e, g->state);
+
+    /* Only the lines with a match are expanded */
+    if (g->n_codes == g->codes_size) {
+        tmp = realloc(g->codes, 2 * (g->codes_size + 1) * sizeof(uint32_t));
+        if (tmp == NULL)
+            return -1;
+        g->codes = tmp;
+        g->codes_size = 2 * (g->codes_size + 1);
+    }
+    if (e->flags & GREP_NEWLINE) {
+        if (g->pending) {
+            g->codes[g->n_codes++] = code;
+            if (grep_expand(g, d) == -1 || grep_lines(g, 0) == -1)
+                return -1;
+        }
+        g->n_line = 0;
+        g->codes[0] = code;
+        g->n_codes = 1;
+        g->skip = 1;
+    } else {
+        g->codes[g->n_codes++] = code;
+    }
+
+    /* The first byte of the new entry is known before its label */
+    d->root[d->d_next].parent = code;
+    g->entries[d->d_next].first = e->first;
+    ++(d->d_next);
+
+    /* The secondary dictionary is filled with the bytes of the phrase */
+    if (d->d_next > d->d_thr) {
+        i = d->d_size;
+        while (1) {
+            d->bytebuf[--i] = d->root[code].label;
+            if (code < d->d_first)
+                break;
+            code = d->root[code].parent;
+        }
+        for (; i < d->d_size; ++i)
+            ht_dictionary_update(d_sec, (uint8_t) d->bytebuf[i]);
+    }
+
+    /* The codes of the line do not survive the swap */
+    if (d->d_next == d->d_size) {
+        if (grep_expand(g, d) == -1)
+            return -1;
+        dictionary_swap(d, d_sec);
+        for (i = d->d_first; i < d->d_next; ++i)
+            grep_entry_fill(g, d, i);
+    }
+    return 0;
+}
+
+uint8_t lz78_grep(lz78_instance* lz78, int fd_in, const char* pattern,
+                  int fd_out) {
+    bit_file* in = NULL;
+    lz78_d* o;
+    grep* g;
+    dictionary* d;
+    uint32_t bits, code;
+    uint32_t pad;
+    uint64_t pos = 0;
+    uint8_t size_code;
+    int flags;
+    int ret;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+        return LZ78_ERROR_MODE;
+
+    if (strlen(pattern) == 0 || strlen(pattern) > LZ78_GREP_MAX ||
+            strchr(pattern, '\n') != NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    lz78_reset(lz78);
+    o = (lz78_d*)&lz78->state;
+    if (o->main == NULL)
+        return LZ78_ERROR_DICTIONARY;
+    o->n_prime = 0;
+
+    g = calloc(1, sizeof(grep));
+    if (g == NULL)
+        return LZ78_ERROR_DICTIONARY;
+    g->pattern = pattern;
+    g->m = strlen(pattern);
+    g->fd_out = fd_out;
+
+    flags = fcntl(fd_in, F_GETFL);
+    if (flags == -1 || fcntl(fd_in, F_SETFL, flags & ~O_NONBLOCK) == -1 ||
+            (in = bit_open(fd_in, ACCESS_READ, B_SIZE_DEFAULT)) == NULL) {
+        if (flags != -1)
+            fcntl(fd_in, F_SETFL, flags);
+        free(g);
+        return LZ78_ERROR_READ;
+    }
+
+    ret = LZ78_SUCCESS;
+    while (ret == LZ78_SUCCESS) {
+        d = o->main;
+        bits = bitlen(d->d_next);
+        o->bitbuf = 0;
+        ret = bit_read(in, (char*) &o->bitbuf, bits, 0);
+        if (ret != (int) bits) {
+            ret = (ret == -1) ? LZ78_ERROR_READ : LZ78_ERROR_DECOMPRESS;
+            break;
+        }
+        ret = LZ78_SUCCESS;
+        pos += bits;
+        code = o->bitbuf;
+
+        /* Phrases of the byte alphabet */
+        if (o->alphabet == ALPHABET_BYTE && d->d_next != DICT_SIZE_MAX &&
+                (code < ALPHABET_BYTE || code >= d->d_first)) {
+            switch (grep_code(o, g, code)) {
+                case -1:
+                    ret = LZ78_ERROR_WRITE;
+                    break;
+                case -2:
+                    ret = LZ78_ERROR_DECOMPRESS;
+                    break;
+            }
+            continue;
+        }
+
+        /* Control codes (the size code creates the tables) */
+        size_code = (d->d_next == DICT_SIZE_MAX);
+        switch (decompress_code(o, code)) {
+            case -1:
+                ret = LZ78_ERROR_DICTIONARY;
+                continue;
+            case -2:
+                ret = LZ78_ERROR_DECOMPRESS;
+                continue;
+        }
+        /* The start code selected the 16-bit alphabet: not supported */
+        if (o->alphabet == ALPHABET_WIDE) {
+            ret = LZ78_ERROR_MODE;
+        } else if (o->completed) {
+            if (g->pending && (grep_expand(g, o->main) == -1 ||
+                               grep_lines(g, 1) == -1))
+                ret = LZ78_ERROR_WRITE;
+            break;
+        } else if (o->flush) {
+            o->flush = 0;
+            pad = (8 - pos % 8) % 8;
+            if (pad > 0 &&
+                    bit_read(in, (char*) &o->bitbuf, pad, 0) != (int) pad)
+                ret = LZ78_ERROR_DECOMPRESS;
+            pos += pad;
+        } else if (size_code && g->entries == NULL) {
+            g->entries = malloc(o->main->d_size * sizeof(grep_entry));
+            if (g->entries == NULL)
+                ret = LZ78_ERROR_DICTIONARY;
+            else
+                grep_init(g);
+        }
+    }
+
+    if (ret == LZ78_SUCCESS && grep_flush(g) == -1)
+        ret = LZ78_ERROR_WRITE;
+
+    /* The bit_file is released without closing the descriptor */
+    free(in);
+    free(g->entries);
+    free(g->codes);
+    free(g->line);
+    free(g);
+    fcntl(fd_in, F_SETFL, flags);
+    return ret;
+}
+
+/* Return the number of newlines of a symbol */
+static inline uint32_t info_newlines(uint32_t label, uint8_t width) {
+    return ((label & 0xff) == '\n') + (width == 2 && (label >> 8) == '\n');
+}
+
+/* Compute the entry of the statistics of a complete dictionary entry from
+   the one of its parent (single symbols have no parent) */
+static inline void info_fill(info_entry* entries, dictionary* d,
+                             uint32_t code) {
+    info_entry* e = &entries[code];
+    info_entry* pe = &entries[d->root[code].parent];
+    uint32_t label = d->root[code].label;
+
+    if (code < d->d_first) {
+        e->first = label;
+        e->len = d->width;
+        e->lines = info_newlines(label, d->width);
+    } else {
+        e->first = pe->first;
+        e->len = pe->len + d->width;
+        e->lines = pe->lines + info_newlines(label, d->width);
+    }
+}
+
+/* Add to the histogram the symbols of the codes counted since the last
+   swap: the uses of each entry are moved to its parent (children follow
+   their parents in the dictionary), so each label is counted once per
+   phrase passing through it */
+static void info_count(info_entry* entries, dictionary* d, lz78_stats* s) {
+    uint32_t label;
+    uint32_t i;
+
+    for (i = d->d_next; i-- > 0;) {
+        if (entries[i].uses == 0)
+            continue;
+        label = d->root[i].label;
+        s->histogram[label & 0xff] += entries[i].uses;
+        if (d->width == 2)
+            s->histogram[label >> 8] += entries[i].uses;
+        if (i >= d->d_first)
+            entries[d->root[i].parent].uses += entries[i].uses;
+        entries[i].uses = 0;
+    }
+}
+
+/* Account a code from the totals of its phrase (instead of its bytes) and
+   update the dictionaries as decompress_code() does
+   Return:  0 on success, -2 on bad code
+ */
+static int info_code(lz78_d* o, info_entry* entries, lz78_stats* s,
+                     uint32_t code) {
+    dictionary* d = o->main;
+    ht_dictionary* d_sec = o->secondary;
+    uint8_t width = d->width;
+    uint32_t i, p;
+
+    if (code >= d->d_next)
+        return -2;
+
+    /* The phrase completes the last entry with its first symbol */
+    if (d->d_next > d->d_min) {
+        d->root[d->d_next - 1].label = entries[code].first;
+        info_fill(entries, d, d->d_next - 1);
+    }
+
+    s->size += entries[code].len;
+    s->lines += entries[code].lines;
+    ++(entries[code].uses);
+
+    /* The first symbol of the new entry is known before its label */
+    d->root[d->d_next].parent = code;
+    entries[d->d_next].first = entries[code].first;
+    ++(d->d_next);
+
+    /* The secondary dictionary is filled with the symbols of the phrase */
+    if (d->d_next > d->d_thr) {
+        i = d->d_size * width;
+        p = code;
+        while (1) {
+            i -= width;
+            d->bytebuf[i] = d->root[p].label;
+            if (width == 2)
+                d->bytebuf[i + 1] = d->root[p].label >> 8;
+            if (p < d->d_first)
+                break;
+            p = d->root[p].parent;
+        }
+        for (; i < d->d_size * width; i += width)
+            ht_dictionary_update(d_sec, (width == 1) ?
+                                 (uint8_t) d->bytebuf[i] :
+                                 (uint8_t) d->bytebuf[i] |
+                                 (uint8_t) d->bytebuf[i + 1] << 8);
+    }
+
+    /* The uses are counted before the entries are replaced */
+    if (d->d_next == d->d_size) {
+        info_count(entries, d, s);
+        dictionary_swap(d, d_sec);
+        ++(o->swaps);
+        for (i = d->d_first; i < d->d_next; ++i)
+            info_fill(entries, d, i);
+    }
+    return 0;
+}
+
+uint8_t lz78_info(lz78_instance* lz78, int fd_in, lz78_stats* stats) {
+    info_entry* entries = NULL;
+    bit_unpacker b;
+    lz78_d* o;
+    dictionary* d;
+    char* buf;
+    uint32_t code;
+    uint32_t i;
+    uint8_t size_code;
+    uint8_t tail;
+    int n;
+    int ret;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_DECOMPRESS)
+        return LZ78_ERROR_MODE;
+
+    lz78_reset(lz78);
+    o = (lz78_d*)&lz78->state;
+    if (o->main == NULL)
+        return LZ78_ERROR_DICTIONARY;
+    o->n_prime = 0;
+    memset(stats, 0, sizeof(lz78_stats));
+
+    buf = malloc(INDEX_BUFFER);
+    if (buf == NULL)
+        return LZ78_ERROR_DICTIONARY;
+    b.p = b.end = (const uint8_t*) buf;
+    b.acc = 0;
+    b.n_acc = 0;
+
+    ret = LZ78_SUCCESS;
+    while (ret == LZ78_SUCCESS) {
+        /* The codes are unpacked from memory, refilled from fd_in */
+        d = o->main;
+        if (unpack_code(&b, bitlen(d->d_next), &code) == -1) {
+            n = pipe_read(fd_in, buf, INDEX_BUFFER);
+            if (n <= 0)
+                ret = (n == -1) ? LZ78_ERROR_READ : LZ78_ERROR_DECOMPRESS;
+            b.p = (const uint8_t*) buf;
+            b.end = b.p + ((n > 0) ? n : 0);
+            continue;
+        }
+
+        /* Phrases */
+        if (entries != NULL && !o->tail && d->d_next != DICT_SIZE_MAX &&
+                (code < o->alphabet || code >= d->d_first)) {
+            if (info_code(o, entries, stats, code) == -2)
+                ret = LZ78_ERROR_DECOMPRESS;
+            continue;
+        }
+
+        /* Control codes (the size code creates the tables) */
+        size_code = (d->d_next == DICT_SIZE_MAX);
+        tail = o->tail;
+        switch (decompress_code(o, code)) {
+            case -1:
+                ret = LZ78_ERROR_DICTIONARY;
+                continue;
+            case -2:
+                ret = LZ78_ERROR_DECOMPRESS;
+                continue;
+        }
+        d = o->main;
+        if (o->completed) {
+            if (entries != NULL)
+                info_count(entries, d, stats);
+            break;
+        } else if (o->flush) {
+            /* The next code starts at the next byte */
+            o->flush = 0;
+            b.acc >>= b.n_acc % 8;
+            b.n_acc -= b.n_acc % 8;
+        } else if (tail) {
+            /* Odd trailing byte of a stream of 16-bit symbols */
+            ++(stats->size);
+            ++(stats->histogram[code]);
+            stats->lines += (code == '\n');
+        } else if (size_code && entries == NULL) {
+            entries = calloc(d->d_size, sizeof(info_entry));
+            if (entries == NULL) {
+                ret = LZ78_ERROR_DICTIONARY;
+                continue;
+            }
+            for (i = 0; i < d->d_next; ++i)
+                info_fill(entries, d, i);
+        }
+    }
+
+    free(entries);
+    free(buf);
+    return ret;
+}
+
+uint8_t lz78_estimate(lz78_instance* lz78, const char* in, uint64_t n_in,
+                      double* ratio, double* speed) {
+    struct timespec t0, t1;
+    lz78_c* o;
+    uint64_t step;
+    uint64_t pos;
+    uint64_t parsed = 0;
+    uint64_t bits;
+    uint32_t i, n;
+    double elapsed;
+
+    if (lz78 == NULL)
+        return LZ78_ERROR_INITIALIZATION;
+
+    if (lz78->mode != LZ78_MODE_COMPRESS)
+        return LZ78_ERROR_MODE;
+
+    lz78_reset(lz78);
+    o = (lz78_c*)&lz78->state;
+    bits = o->n_bits;
+    o->n_bits = 0;
+
+    /* The samples are parsed as a single stream: only the size of the codes
+       is accounted, nothing is packed */
+    step = (n_in > ESTIMATE_SAMPLES * ESTIMATE_SAMPLE) ?
+           n_in / ESTIMATE_SAMPLES : ESTIMATE_SAMPLE;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (pos = 0; pos < n_in; pos += step) {
+        n = (n_in - pos < ESTIMATE_SAMPLE) ? n_in - pos : ESTIMATE_SAMPLE;
+        for (i = 0; i < n; ++i) {
+            compress_byte(o, (uint8_t) in[pos + i]);
+            bits += o->n_bits;
+            o->n_bits = 0;
+        }
+        parsed += n;
+    }
+    while (o->completed == 0) {
+        compress_byte(o, EOF);
+        bits += o->n_bits;
+        o->n_bits = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    *ratio = (parsed > 0) ? (bits / 8.0) / parsed : 1;
+    *speed = (elapsed > 0) ? parsed / elapsed : 0;
+    return LZ78_SUCCESS;
+}
+
 void lz78_destroy(lz78_instance *lz78) {
     lz78_c *c;
     lz78_d *d;
@@ -633,6 +3345,9 @@ void lz78_destroy(lz78_instance *lz78) {
                 break;
         }
 
+        while (lz78->n_segments > 0)
+            free(lz78->segments[--(lz78->n_segments)].iov_base);
+        free(lz78->segments);
         free(lz78);
     }
 }
@@ -20,8 +20,14 @@
 #ifndef __LZ78_H
 #define __LZ78_H
 
+#include <sys/uio.h>
+
 #include "bitio.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* Modes of compression */
 #define LZ78_MODE_COMPRESS        0
 #define LZ78_MODE_DECOMPRESS      1
@@ -36,15 +42,49 @@
 #define LZ78_ERROR_DECOMPRESS     6 
 #define LZ78_ERROR_INITIALIZATION 7
 #define LZ78_ERROR_MODE           8
+#define LZ78_ERROR_PIPELINE       9
+
+/* List of lz78 options */
+#define LZ78_OPTION_ALPHABET      1
+#define LZ78_OPTION_FLUSH_MS      2
+#define LZ78_OPTION_FLUSH_LINES   3
+#define LZ78_OPTION_FOLLOW        4
+
+/* Sizes (bits) of the symbols of the alphabet */
+#define LZ78_ALPHABET_BYTE        8
+#define LZ78_ALPHABET_WIDE        16
 
 /* Size of the dictionary */
 #define DICT_SIZE_MIN                260
 #define DICT_SIZE_DEFAULT            4096
 #define DICT_SIZE_MAX                1048576
+/* Minimum size of the dictionary with the 16-bit alphabet */
+#define DICT_SIZE_MIN_WIDE           262144
+
+/* Default interval between the checkpoints of lz78_index() (bytes of
+   decompressed data) */
+#define LZ78_CHECKPOINT_DEFAULT      16777216
+
+/* Maximum length of the pattern of lz78_grep() */
+#define LZ78_GREP_MAX                63
+
+/* Worst case size of the compression of n bytes (every code is at most
+   21 bits long and the stream holds at most n + 3 codes) */
+#define LZ78_BOUND(n) ((uint32_t)((((uint64_t)(n) + 3) * 21 + 7) / 8))
 
 /* Opaque type representing the compression instance */
 typedef struct __lz78_instance lz78_instance;
 
+/* Statistics of the data of a stream computed by lz78_info() */
+struct __lz78_stats {
+    uint64_t size;            /* Size of the data (bytes) */
+    uint64_t lines;           /* Number of newlines of the data */
+    uint64_t histogram[256];  /* Occurrences of each byte value */
+};
+
+/* The type of the statistics of the data of a stream */
+typedef struct __lz78_stats lz78_stats;
+
 /* Allocate and return an instance of lz78 compressor
    cmode:   specify compress/decompress mode
    dsize:   specify the size of the dictionary (byte)
@@ -53,18 +93,186 @@ lz78_instance* lz78_new(uint8_t cmode, uint32_t dsize);
 
 /* Compress the input stream by sending the result to the output stream
    arg:     current instance of compressor obtained by invoking lz78_init()
-   Return:  one of defined lz78-level return codes
+   Return:  one of defined lz78-level return codes; after LZ78_ERROR_EAGAIN
+            (non-blocking descriptors) a call with the same descriptors
+            resumes the compression
  */
 uint8_t lz78_compress(lz78_instance* lz78, int fd_in, int fd_out);
 
 /* Decompress the input stream by sending the result to the output stream
    arg:     current instance of compressor obtained by invoking lz78_init()
-   Return:  one of defined lz78-level return codes
+   Return:  one of defined lz78-level return codes; after LZ78_ERROR_EAGAIN
+            (non-blocking input) a call with the same descriptors resumes the
+            decompression (the output must block: the data it buffers is
+            lost when a write would block)
  */
 uint8_t lz78_decompress(lz78_instance* lz78, int fd_in, int fd_out);
 
+/* Same as lz78_compress, but reading, dictionary updates and bit packing
+   plus writing run on three threads connected by ring buffers
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_compress_pipelined(lz78_instance* lz78, int fd_in, int fd_out);
+
+/* Same as lz78_decompress, but reading, code decoding and writing run on
+   three threads connected by ring buffers
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_decompress_pipelined(lz78_instance* lz78, int fd_in, int fd_out);
+
+/* Set an option of the compressor: LZ78_OPTION_ALPHABET selects symbols of
+   LZ78_ALPHABET_BYTE or LZ78_ALPHABET_WIDE bits (pairs of bytes, e.g. UTF-16
+   text, each taking one dictionary step), which needs a dictionary of at
+   least DICT_SIZE_MIN_WIDE entries. The decompressor learns the alphabet
+   from the stream. LZ78_OPTION_FLUSH_MS and LZ78_OPTION_FLUSH_LINES make
+   lz78_compress() emit a flush point once the given milliseconds have
+   passed since the first byte not flushed (also while the input is idle),
+   or every given number of lines (0 disables them). LZ78_OPTION_FOLLOW makes
+   lz78_compress() wait (with inotify) for data appended to a regular input
+   file at its end, with flush points every second unless an interval is
+   set, until the file is removed or renamed or lz78_stop() is invoked.
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_set(lz78_instance* lz78, uint8_t option, uint32_t value);
+
+/* Request a flush point, emitted by lz78_compress() before reading more
+   input: the codes of the data read so far are written out, followed by a
+   flush code and the padding up to the next byte, so that the decompressor
+   outputs all of it without waiting for the rest of the stream (the odd
+   byte of a 16-bit symbol is held back)
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_flush(lz78_instance* lz78);
+
+/* End a followed input at its current end (async-signal-safe)
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_stop(lz78_instance* lz78);
+
+/* Reset the instance so that it can be used for a new stream */
+void lz78_reset(lz78_instance* lz78);
+
+/* Prime the dictionary of the next stream with data preceding it (e.g. the
+   tail of the previous block): the dictionary is filled by parsing the data
+   without emitting codes. Compressor and decompressor must be primed with
+   the same data, which must stay valid until the stream starts.
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_prime(lz78_instance* lz78, const char* data, uint32_t n);
+
+/* Compress a memory buffer into a complete lz78 stream (the instance is
+   reset before use)
+   out:     buffer of at least LZ78_BOUND(n_in) bytes
+   n_out:   size of the compressed stream
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_compress_mem(lz78_instance* lz78, const char* in, uint32_t n_in,
+                          char* out, uint32_t* n_out);
+
+/* Decompress a complete lz78 stream held in memory (the instance is reset
+   before use)
+   n_out:   size of out, replaced by the size of the decompressed data
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_decompress_mem(lz78_instance* lz78, const char* in, uint32_t n_in,
+                            char* out, uint32_t* n_out);
+
+/* Compress the data gathered from the iovcnt buffers of iov into a complete
+   lz78 stream (the instance is reset before use), held in buffers owned by
+   the instance
+   out:     set to the segments of the stream, ready for writev(), valid
+            until the next call on the instance or its destruction
+   n_out:   number of segments
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_compress_iov(lz78_instance* lz78, const struct iovec* iov,
+                          int iovcnt, const struct iovec** out, int* n_out);
+
+/* Decompress a complete lz78 stream gathered from the iovcnt buffers of iov
+   (codes may span buffers; the instance is reset before use) into buffers
+   owned by the instance
+   out:     set to the segments of the data, ready for writev(), valid until
+            the next call on the instance or its destruction
+   n_out:   number of segments (0 for an empty stream)
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_decompress_iov(lz78_instance* lz78, const struct iovec* iov,
+                            int iovcnt, const struct iovec** out,
+                            int* n_out);
+
+/* Start decoding a complete lz78 stream held in memory phrase by phrase
+   with lz78_next_phrase() (the instance is reset before use); in must stay
+   valid until the last phrase
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_phrases(lz78_instance* lz78, const char* in, uint32_t n_in);
+
+/* Decode the next phrase of the stream started by lz78_phrases() without
+   copying it
+   data:    set to the phrase, inside the buffer of the dictionary of the
+            instance: valid until the next call on the instance
+   n:       size of the phrase, 0 at the end of the stream
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_next_phrase(lz78_instance* lz78, const char** data,
+                         uint32_t* n);
+
+/* Decode a whole stream read from fd_in without writing its data, writing
+   to fd_out a side index of checkpoints of the decoder: at the first swap
+   of the dictionaries after every interval bytes of decompressed data (0
+   selects LZ78_CHECKPOINT_DEFAULT) the offsets of the data and of the next
+   code (bits) and the entries of the main dictionary are stored
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_index(lz78_instance* lz78, int fd_in, int fd_out,
+                   uint64_t interval);
+
+/* Decompress the n bytes of data starting at offset of the stream read from
+   fd_in (which must be seekable), sending them to fd_out: decoding resumes
+   from the nearest checkpoint preceding offset of the index written by
+   lz78_index() and read from fd_index (seekable), or from the start of the
+   stream if fd_index is -1
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_decompress_range(lz78_instance* lz78, int fd_in, int fd_index,
+                              uint64_t offset, uint64_t n, int fd_out);
+
+/* Write to fd_out the lines of the stream read from fd_in which contain the
+   pattern (at most LZ78_GREP_MAX bytes, no newline), searching it in the
+   codes: the state of the matcher after the phrase of each dictionary entry
+   is kept with the entry, so that each code is processed at once without
+   expanding it, and only the lines containing the pattern are expanded.
+   Streams of 16-bit symbols are not supported (LZ78_ERROR_MODE).
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_grep(lz78_instance* lz78, int fd_in, const char* pattern,
+                  int fd_out);
+
+/* Compute the size, the newlines and the byte histogram of the data of the
+   stream read from fd_in without writing them: the length and the newlines
+   of the phrase of each dictionary entry are kept with the entry, so that
+   the totals are accumulated per code, and the histogram is collected from
+   the codes counted on each entry at every swap of the dictionaries; every
+   code is validated, so this is also the integrity test of a stream
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_info(lz78_instance* lz78, int fd_in, lz78_stats* stats);
+
+/* Estimate the compression of a buffer without compressing it: evenly
+   spaced samples (at most 1 MB) are parsed without emitting any code (the
+   instance is reset before use)
+   ratio:   predicted ratio between the compressed and the input size
+   speed:   predicted compression throughput, I/O excluded (bytes per second)
+   Return:  one of defined lz78-level return codes
+ */
+uint8_t lz78_estimate(lz78_instance* lz78, const char* in, uint64_t n_in,
+                      double* ratio, double* speed);
 
 /* Deallocate current instance */
 void lz78_destroy(lz78_instance* lz78);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* __LZ78_H */
@@ -0,0 +1,373 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Header-only C++20 interface of the lz78 core: move-only engines owning
+   an instance, std::span buffers and awaitable streaming operations. No
+   operation allocates but the construction of an engine (which throws
+   std::bad_alloc on failure); every other outcome is a status. */
+
+#ifndef __LZ78_HPP
+#define __LZ78_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <span>
+#include <utility>
+
+#include "lz78.h"
+
+namespace lz78 {
+
+/* Outcome of an operation (the lz78-level return codes) */
+enum class status : uint8_t {
+    success        = LZ78_SUCCESS,
+    dictionary     = LZ78_ERROR_DICTIONARY,
+    read           = LZ78_ERROR_READ,
+    write          = LZ78_ERROR_WRITE,
+    again          = LZ78_ERROR_EAGAIN,
+    compress       = LZ78_ERROR_COMPRESS,
+    decompress     = LZ78_ERROR_DECOMPRESS,
+    initialization = LZ78_ERROR_INITIALIZATION,
+    mode           = LZ78_ERROR_MODE,
+    pipeline       = LZ78_ERROR_PIPELINE
+};
+
+/* Dictionary size given to the constructor instead of by the type */
+inline constexpr uint32_t dynamic_size = 0;
+
+/* Worst case size of the compression of n bytes */
+constexpr std::size_t bound(std::size_t n) {
+    return ((n + 3) * 21 + 7) / 8;
+}
+
+namespace detail {
+
+/* Owner of an instance of the core in the given mode: the dictionary size
+   is either fixed by the type or dynamic_size. A fixed size is only
+   validated at compile time and passed to the same core, the code path is
+   the one of a dynamic size */
+template <uint8_t Mode, uint32_t DictSize>
+class engine {
+    static_assert(DictSize == dynamic_size ||
+                  (DictSize >= DICT_SIZE_MIN && DictSize <= DICT_SIZE_MAX),
+                  "lz78: dictionary size out of range");
+
+public:
+    engine() requires (DictSize != dynamic_size) : i(create(DictSize)) {}
+
+    explicit engine(uint32_t dsize = DICT_SIZE_DEFAULT)
+        requires (DictSize == dynamic_size) : i(create(dsize)) {}
+
+    engine(const engine&) = delete;
+    engine& operator=(const engine&) = delete;
+
+    engine(engine&& e) noexcept : i(std::exchange(e.i, nullptr)) {}
+
+    engine& operator=(engine&& e) noexcept {
+        std::swap(i, e.i);
+        return *this;
+    }
+
+    ~engine() {
+        lz78_destroy(i);
+    }
+
+    /* Set an option (LZ78_OPTION_*) of the instance */
+    status set(uint8_t option, uint32_t value) noexcept {
+        return static_cast<status>(lz78_set(i, option, value));
+    }
+
+    /* Prime the dictionary of the next stream (data must stay valid until
+       the stream starts) */
+    status prime(std::span<const std::byte> data) noexcept {
+        if (data.size() > UINT32_MAX)
+            return status::initialization;
+        return static_cast<status>(lz78_prime(i,
+                                   reinterpret_cast<const char*>(data.data()),
+                                   data.size()));
+    }
+
+    /* Reset the instance for a new stream */
+    void reset() noexcept {
+        lz78_reset(i);
+    }
+
+    /* Instance of the core, still owned by the engine */
+    lz78_instance* native_handle() const noexcept {
+        return i;
+    }
+
+protected:
+    lz78_instance* i;
+
+private:
+    static lz78_instance* create(uint32_t dsize) {
+        lz78_instance* p = lz78_new(Mode, dsize);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return p;
+    }
+};
+
+/* Awaitable streaming operation between two descriptors: the core is run
+   when awaited and, where it returns LZ78_ERROR_EAGAIN, the coroutine is
+   suspended and a resumer is handed to wait(resumer, fd_in, fd_out), which
+   must invoke it once a descriptor is ready (e.g. from an event loop). The
+   resumer runs the core again, waiting anew on EAGAIN, and resumes the
+   coroutine with the final status. */
+template <class Engine, class Wait>
+class stream_awaitable {
+public:
+    /* Copyable callable retrying the operation */
+    class resumer {
+    public:
+        explicit resumer(stream_awaitable* a) noexcept : a(a) {}
+
+        void operator()() const {
+            a->st = a->e->run(a->fd_in, a->fd_out);
+            if (a->st == status::again)
+                a->wait(*this, a->fd_in, a->fd_out);
+            else
+                a->h.resume();
+        }
+
+    private:
+        stream_awaitable* a;
+    };
+
+    stream_awaitable(Engine* e, int fd_in, int fd_out, Wait wait)
+        : e(e), fd_in(fd_in), fd_out(fd_out), wait(std::move(wait)) {}
+
+    bool await_ready() {
+        st = e->run(fd_in, fd_out);
+        return st != status::again;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        h = handle;
+        wait(resumer(this), fd_in, fd_out);
+    }
+
+    status await_resume() const noexcept {
+        return st;
+    }
+
+private:
+    Engine* e;
+    int fd_in;
+    int fd_out;
+    Wait wait;
+    std::coroutine_handle<> h;
+    status st = status::success;
+};
+
+} /* namespace detail */
+
+/* Compressor (move-only): basic_compressor<65536> fixes the dictionary
+   size, compressor takes it from the constructor */
+template <uint32_t DictSize = dynamic_size>
+class basic_compressor : public detail::engine<LZ78_MODE_COMPRESS, DictSize> {
+public:
+    using detail::engine<LZ78_MODE_COMPRESS, DictSize>::engine;
+
+    /* Compress in into a complete stream (the instance is reset before
+       use); out must hold bound(in.size()) bytes and is shrunk to the
+       stream on success */
+    status compress(std::span<const std::byte> in,
+                    std::span<std::byte>& out) noexcept {
+        uint32_t n;
+        status st;
+
+        if (in.size() > UINT32_MAX || bound(in.size()) > UINT32_MAX)
+            return status::compress;
+        if (out.size() < bound(in.size()))
+            return status::write;
+        st = static_cast<status>(lz78_compress_mem(this->i,
+                                 reinterpret_cast<const char*>(in.data()),
+                                 in.size(),
+                                 reinterpret_cast<char*>(out.data()), &n));
+        if (st == status::success)
+            out = out.first(n);
+        return st;
+    }
+
+    /* Compress the stream read from fd_in to fd_out; status::again asks to
+       call it again once the descriptors are ready */
+    status compress(int fd_in, int fd_out) noexcept {
+        return run(fd_in, fd_out);
+    }
+
+    /* Awaitable version of compress(fd_in, fd_out) (see stream_awaitable) */
+    template <class Wait>
+    auto compress_async(int fd_in, int fd_out, Wait wait) {
+        return detail::stream_awaitable<basic_compressor, Wait>(
+                   this, fd_in, fd_out, std::move(wait));
+    }
+
+    /* Emit a flush point (see lz78_flush()) */
+    status flush() noexcept {
+        return static_cast<status>(lz78_flush(this->i));
+    }
+
+    /* End a followed input at its current end (async-signal-safe) */
+    status stop() noexcept {
+        return static_cast<status>(lz78_stop(this->i));
+    }
+
+private:
+    template <class, class> friend class detail::stream_awaitable;
+
+    status run(int fd_in, int fd_out) noexcept {
+        return static_cast<status>(lz78_compress(this->i, fd_in, fd_out));
+    }
+};
+
+/* Decompressor (move-only): basic_decompressor<65536> fixes the size of
+   its first dictionary, decompressor takes it from the constructor */
+template <uint32_t DictSize = dynamic_size>
+class basic_decompressor :
+        public detail::engine<LZ78_MODE_DECOMPRESS, DictSize> {
+public:
+    using detail::engine<LZ78_MODE_DECOMPRESS, DictSize>::engine;
+
+    /* Phrases of a stream held in memory, decoded one at a time without
+       copies: each phrase is valid until the iterator is advanced, and
+       the outcome of the decoding is available at the end */
+    class phrase_range {
+    public:
+        class iterator {
+        public:
+            using value_type = std::span<const std::byte>;
+            using difference_type = std::ptrdiff_t;
+
+            iterator() = default;
+
+            explicit iterator(phrase_range* r) : r(r) {
+                ++(*this);
+            }
+
+            value_type operator*() const noexcept {
+                return phrase;
+            }
+
+            iterator& operator++() noexcept {
+                const char* p;
+                uint32_t n;
+
+                r->st = static_cast<status>(lz78_next_phrase(r->i, &p, &n));
+                phrase = (r->st == status::success) ?
+                         value_type(reinterpret_cast<const std::byte*>(p), n) :
+                         value_type();
+                return *this;
+            }
+
+            void operator++(int) noexcept {
+                ++(*this);
+            }
+
+            bool operator==(std::default_sentinel_t) const noexcept {
+                return phrase.empty();
+            }
+
+        private:
+            phrase_range* r = nullptr;
+            value_type phrase;
+        };
+
+        phrase_range(lz78_instance* i, std::span<const std::byte> in)
+            : i(i) {
+            st = (in.size() > UINT32_MAX) ? status::decompress :
+                 static_cast<status>(lz78_phrases(i,
+                                     reinterpret_cast<const char*>(in.data()),
+                                     in.size()));
+        }
+
+        iterator begin() {
+            return (st == status::success) ? iterator(this) : iterator();
+        }
+
+        std::default_sentinel_t end() const noexcept {
+            return std::default_sentinel;
+        }
+
+        /* Outcome of the decoding once the phrases are exhausted */
+        status result() const noexcept {
+            return st;
+        }
+
+    private:
+        lz78_instance* i;
+        status st;
+    };
+
+    /* Decompress the complete stream in (the instance is reset before use)
+       into out, which is shrunk to the data on success */
+    status decompress(std::span<const std::byte> in,
+                      std::span<std::byte>& out) noexcept {
+        uint32_t n = (out.size() > UINT32_MAX) ? UINT32_MAX : out.size();
+        status st;
+
+        if (in.size() > UINT32_MAX)
+            return status::decompress;
+        st = static_cast<status>(lz78_decompress_mem(this->i,
+                                 reinterpret_cast<const char*>(in.data()),
+                                 in.size(),
+                                 reinterpret_cast<char*>(out.data()), &n));
+        if (st == status::success)
+            out = out.first(n);
+        return st;
+    }
+
+    /* Decompress the stream read from fd_in to fd_out; status::again asks
+       to call it again once the descriptors are ready */
+    status decompress(int fd_in, int fd_out) noexcept {
+        return run(fd_in, fd_out);
+    }
+
+    /* Awaitable version of decompress(fd_in, fd_out) (see
+       stream_awaitable): it suspends on the input, fd_out must block */
+    template <class Wait>
+    auto decompress_async(int fd_in, int fd_out, Wait wait) {
+        return detail::stream_awaitable<basic_decompressor, Wait>(
+                   this, fd_in, fd_out, std::move(wait));
+    }
+
+    /* Phrases of the complete stream in, which must outlive them */
+    phrase_range phrases(std::span<const std::byte> in) noexcept {
+        return phrase_range(this->i, in);
+    }
+
+private:
+    template <class, class> friend class detail::stream_awaitable;
+
+    status run(int fd_in, int fd_out) noexcept {
+        return static_cast<status>(lz78_decompress(this->i, fd_in, fd_out));
+    }
+};
+
+/* Engines with the dictionary size given at run time */
+using compressor = basic_compressor<>;
+using decompressor = basic_decompressor<>;
+
+} /* namespace lz78 */
+
+#endif /* __LZ78_HPP */
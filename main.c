@@ -19,23 +19,86 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 
 #include "wrapper.h"
 
 /* Usage program help */
 void help(char* argv[]) {
     fprintf(stderr,
-            "Usage: %s [Options]\n\n"
+            "Usage: %s [Options] [files...]\n\n"
             "Options:\n"
             "-h          show this help\n"
             "-i input    sets input source\n"
             "-o output   sets output destination\n"
             "-d          sets decompress mode\n"
-            "-t type     sets compression algorithm\n"
+            "-t type     sets compression algorithm (lz78, lz77)\n"
             "\n"
             "Optional flags:\n"
             "-b bsize    sets size of I/O buffers\n"
+            "-P          sets pipelined (multi-threaded) mode\n"
             "-a param    sets additional parameter\n"
+            "            (lz78: dictionary size, lz77: block size)\n"
+            "-W, --wide      sets the lz78 alphabet to 16-bit symbols (pairs\n"
+            "                of bytes, e.g. UTF-16 text; dictionaries of at\n"
+            "                least 256K entries)\n"
+            "-E, --estimate  writes the predicted lz78 ratio and throughput\n"
+            "                of the input (from samples, without compressing)\n"
+            "--flush-ms ms       flushes the lz78 stream when ms milliseconds\n"
+            "                    have passed since the first byte not flushed,\n"
+            "                    so that a decompressor reading it (e.g. from\n"
+            "                    a live log pipe) outputs the data at once\n"
+            "--flush-lines n     flushes the lz78 stream every n lines\n"
+            "--follow            compresses the -i file as it grows (e.g. a\n"
+            "                    log), flushing every second by default, until\n"
+            "                    it is removed or renamed or lz78 is stopped\n"
+            "                    by SIGINT, SIGTERM or SIGHUP\n"
+            "--index file        with -d decodes the lz78 stream -i once and\n"
+            "                    writes to file an index of checkpoints of\n"
+            "                    the decoder (with --range, reads it)\n"
+            "--index-interval size  sets the data between checkpoints\n"
+            "                    (default: 16M)\n"
+            "--range off[:len]   with -d writes only len bytes (default: up\n"
+            "                    to the end) of data from offset off,\n"
+            "                    resuming from the nearest checkpoint\n"
+            "--grep pattern      writes the lines of the lz78 stream which\n"
+            "                    contain pattern (implies -d), searching it\n"
+            "                    in the codes without decompressing them\n"
+            "--info              writes the size, the lines and the byte\n"
+            "                    histogram of the data of the lz78 stream\n"
+            "                    (implies -d), without decompressing it\n"
+            "--test              verifies the lz78 stream or the archive\n"
+            "                    (implies -d): every block or code is\n"
+            "                    decoded and checked, nothing is written\n"
+            "\n"
+            "Archive mode:\n"
+            "-A, --archive          compress the given files and directories\n"
+            "                       (and -i input) into a single archive;\n"
+            "                       with -d extract the archive -i into the\n"
+            "                       directory -o (only the given files and\n"
+            "                       directories, if any)\n"
+            "-j, --threads n        sets the number of workers (default: cpus)\n"
+            "-B, --block-size size  sets the size of the blocks files are split\n"
+            "                       into (default: 4M)\n"
+            "-T, --files-from list  adds the files listed one per line\n"
+            "-S, --solid            compresses the files as a single stream cut\n"
+            "                       into blocks regardless of file boundaries\n"
+            "-p, --prime size       primes the dictionary of each lz78 block\n"
+            "                       with the tail of the previous block\n"
+            "-N, --numa             pins the workers to the NUMA nodes\n"
+            "-F, --filter list      filters the data of the blocks before\n"
+            "                       compressing them: comma separated list of\n"
+            "                       delta:N (difference from the byte N\n"
+            "                       positions before) and transpose:N (bytes\n"
+            "                       of records of N bytes grouped by position)\n"
+            "-L, --batch n          cuts the blocks every n records (lines) and\n"
+            "                       indexes them, e.g. for logs\n"
+            "--records A-B          with -d writes to -o (or stdout) only the\n"
+            "                       records A to B of a --batch archive,\n"
+            "                       decompressing just the blocks holding them\n"
+            "--no-checksum          stores no checksums of the blocks: stored\n"
+            "                       blocks are then moved inside the kernel\n"
+            "                       without being read by the workers\n"
             "",
             argv[0]);
 }
@@ -50,8 +113,65 @@ int main(int argc, char* argv[]) {
     int opt, ret;
     uint8_t w_mode = WRAPPER_MODE_COMPRESS;
     uint8_t w_type = LZ78_ALGORITHM;
+    uint8_t pipelined = 0;
+    uint8_t archived = 0;
+    char* threads = NULL;
+    char* block_size = NULL;
+    char* file_list = NULL;
+    uint8_t solid = 0;
+    char* prime = NULL;
+    uint8_t numa = 0;
+    uint8_t estimate = 0;
+    uint8_t wide = 0;
+    char* filters = NULL;
+    char* flush_ms = NULL;
+    char* flush_lines = NULL;
+    uint8_t follow = 0;
+    char* batch = NULL;
+    char* records = NULL;
+    char* index = NULL;
+    char* interval = NULL;
+    char* range = NULL;
+    char* pattern = NULL;
+    uint8_t info = 0;
+    uint8_t test = 0;
+    uint8_t no_checksum = 0;
+    static const struct option long_options[] = {
+        {"input",      required_argument, NULL, 'i'},
+        {"output",     required_argument, NULL, 'o'},
+        {"decompress", no_argument,       NULL, 'd'},
+        {"type",       required_argument, NULL, 't'},
+        {"buffer",     required_argument, NULL, 'b'},
+        {"param",      required_argument, NULL, 'a'},
+        {"pipeline",   no_argument,       NULL, 'P'},
+        {"archive",    no_argument,       NULL, 'A'},
+        {"threads",    required_argument, NULL, 'j'},
+        {"block-size", required_argument, NULL, 'B'},
+        {"files-from", required_argument, NULL, 'T'},
+        {"solid",      no_argument,       NULL, 'S'},
+        {"prime",      required_argument, NULL, 'p'},
+        {"numa",       no_argument,       NULL, 'N'},
+        {"estimate",   no_argument,       NULL, 'E'},
+        {"wide",       no_argument,       NULL, 'W'},
+        {"filter",     required_argument, NULL, 'F'},
+        {"flush-ms",   required_argument, NULL, 'f'},
+        {"flush-lines", required_argument, NULL, 'l'},
+        {"follow",     no_argument,       NULL, 'r'},
+        {"batch",      required_argument, NULL, 'L'},
+        {"records",    required_argument, NULL, 'R'},
+        {"index",      required_argument, NULL, 'x'},
+        {"index-interval", required_argument, NULL, 'I'},
+        {"range",      required_argument, NULL, 'g'},
+        {"grep",       required_argument, NULL, 'G'},
+        {"info",       no_argument,       NULL, 'n'},
+        {"test",       no_argument,       NULL, 'y'},
+        {"no-checksum", no_argument,      NULL, 'k'},
+        {"help",       no_argument,       NULL, 'h'},
+        {NULL,         0,                 NULL, 0}
+    };
 
-    while ((opt = getopt(argc, argv, "i:o:dt:b:a:h")) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:o:dt:b:a:PAj:B:T:Sp:NEF:WL:h",
+                              long_options, NULL)) != -1) {
         switch (opt) {
             case 'i': /* Input */
                 name_in = optarg;
@@ -80,6 +200,104 @@ int main(int argc, char* argv[]) {
                 w_argv = optarg;
                 break;
 
+            case 'P': /* Pipelined mode */
+                pipelined = 1;
+                break;
+
+            case 'A': /* Archive mode */
+                archived = 1;
+                break;
+
+            case 'j': /* Number of workers */
+                threads = optarg;
+                break;
+
+            case 'B': /* Size of the blocks of the archive */
+                block_size = optarg;
+                break;
+
+            case 'T': /* List of files to archive */
+                file_list = optarg;
+                break;
+
+            case 'S': /* Solid archive */
+                solid = 1;
+                break;
+
+            case 'p': /* Priming of the blocks */
+                prime = optarg;
+                break;
+
+            case 'N': /* NUMA-aware workers */
+                numa = 1;
+                break;
+
+            case 'E': /* Compression estimate */
+                estimate = 1;
+                break;
+
+            case 'F': /* Filters of the archive */
+                filters = optarg;
+                break;
+
+            case 'W': /* 16-bit alphabet */
+                wide = 1;
+                break;
+
+            case 'f': /* Flush interval */
+                flush_ms = optarg;
+                break;
+
+            case 'l': /* Lines between flushes */
+                flush_lines = optarg;
+                break;
+
+            case 'r': /* Follow the growing input */
+                follow = 1;
+                break;
+
+            case 'L': /* Records per block */
+                batch = optarg;
+                archived = 1;
+                break;
+
+            case 'R': /* Range of records to extract */
+                records = optarg;
+                archived = 1;
+                break;
+
+            case 'x': /* Index of checkpoints */
+                index = optarg;
+                break;
+
+            case 'I': /* Interval between checkpoints */
+                interval = optarg;
+                break;
+
+            case 'g': /* Range of data to decompress */
+                range = optarg;
+                break;
+
+            case 'G': /* Pattern searched */
+                pattern = optarg;
+                w_mode = WRAPPER_MODE_DECOMPRESS;
+                break;
+
+            case 'n': /* Statistics of the data */
+                info = 1;
+                w_mode = WRAPPER_MODE_DECOMPRESS;
+                break;
+
+            case 'y': /* Integrity test */
+                test = 1;
+                w_mode = WRAPPER_MODE_DECOMPRESS;
+                break;
+
+            case 'k': /* Archive without checksums */
+                no_checksum = 1;
+                archived = 1;
+                break;
+
             case 'h': /* Compressor help */
             default:
                 help(argv);
@@ -87,7 +305,8 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    if (bsize <= 0) {
+    /* Positional files are accepted only in archive mode */
+    if (bsize <= 0 || (optind < argc && !archived)) {
         help(argv);
         exit(EXIT_FAILURE);
     }
@@ -99,6 +318,62 @@ int main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    ret = WRAPPER_SUCCESS;
+    if (pipelined)
+        ret = wrapper_set(w, WRAPPER_OPTION_PIPELINE, NULL);
+    if (ret == WRAPPER_SUCCESS && estimate)
+        ret = wrapper_set(w, WRAPPER_OPTION_ESTIMATE, NULL);
+    if (ret == WRAPPER_SUCCESS && archived)
+        ret = wrapper_set(w, WRAPPER_OPTION_ARCHIVE, NULL);
+    if (ret == WRAPPER_SUCCESS && solid)
+        ret = wrapper_set(w, WRAPPER_OPTION_SOLID, NULL);
+    if (ret == WRAPPER_SUCCESS && prime)
+        ret = wrapper_set(w, WRAPPER_OPTION_PRIME, prime);
+    if (ret == WRAPPER_SUCCESS && numa)
+        ret = wrapper_set(w, WRAPPER_OPTION_NUMA, NULL);
+    if (ret == WRAPPER_SUCCESS && wide)
+        ret = wrapper_set(w, WRAPPER_OPTION_WIDE, NULL);
+    if (ret == WRAPPER_SUCCESS && flush_ms)
+        ret = wrapper_set(w, WRAPPER_OPTION_FLUSH_MS, flush_ms);
+    if (ret == WRAPPER_SUCCESS && flush_lines)
+        ret = wrapper_set(w, WRAPPER_OPTION_FLUSH_LINES, flush_lines);
+    if (ret == WRAPPER_SUCCESS && follow)
+        ret = wrapper_set(w, WRAPPER_OPTION_FOLLOW, NULL);
+    if (ret == WRAPPER_SUCCESS && batch)
+        ret = wrapper_set(w, WRAPPER_OPTION_BATCH, batch);
+    if (ret == WRAPPER_SUCCESS && records)
+        ret = wrapper_set(w, WRAPPER_OPTION_RECORDS, records);
+    if (ret == WRAPPER_SUCCESS && index)
+        ret = wrapper_set(w, WRAPPER_OPTION_INDEX, index);
+    if (ret == WRAPPER_SUCCESS && interval)
+        ret = wrapper_set(w, WRAPPER_OPTION_INTERVAL, interval);
+    if (ret == WRAPPER_SUCCESS && range)
+        ret = wrapper_set(w, WRAPPER_OPTION_RANGE, range);
+    if (ret == WRAPPER_SUCCESS && pattern)
+        ret = wrapper_set(w, WRAPPER_OPTION_GREP, pattern);
+    if (ret == WRAPPER_SUCCESS && info)
+        ret = wrapper_set(w, WRAPPER_OPTION_INFO, NULL);
+    if (ret == WRAPPER_SUCCESS && test)
+        ret = wrapper_set(w, WRAPPER_OPTION_TEST, NULL);
+    if (ret == WRAPPER_SUCCESS && no_checksum)
+        ret = wrapper_set(w, WRAPPER_OPTION_NO_CHECKSUM, NULL);
+    if (ret == WRAPPER_SUCCESS && filters)
+        ret = wrapper_set(w, WRAPPER_OPTION_FILTER, filters);
+    if (ret == WRAPPER_SUCCESS && threads)
+        ret = wrapper_set(w, WRAPPER_OPTION_THREADS, threads);
+    if (ret == WRAPPER_SUCCESS && block_size)
+        ret = wrapper_set(w, WRAPPER_OPTION_BLOCK_SIZE, block_size);
+    if (ret == WRAPPER_SUCCESS && file_list)
+        ret = wrapper_set(w, WRAPPER_OPTION_FILE_LIST, file_list);
+    while (ret == WRAPPER_SUCCESS && optind < argc)
+        ret = wrapper_set(w, WRAPPER_OPTION_INPUT, argv[optind++]);
+
+    if (ret != WRAPPER_SUCCESS) {
+        wrapper_perror();
+        wrapper_destroy(w);
+        exit(EXIT_FAILURE);
+    }
+
     /* Executes the wrapper function */
     ret = wrapper_exec(w, name_in, name_out);
     
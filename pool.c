@@ -0,0 +1,356 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "pool.h"
+
+/* State of a task */
+#define TASK_PENDING     0
+#define TASK_DONE        1
+
+/* Result of the attempt to take a task from a queue */
+#define TAKE_OK          0
+#define TAKE_EMPTY       1
+#define TAKE_BLOCKED     2
+
+/* Sysfs directory describing the NUMA topology */
+#define NODE_PATH        "/sys/devices/system/node"
+/* Maximum number of NUMA nodes considered */
+#define NODE_MAX         64
+
+/* Queue of a worker: it holds the tasks worker, worker + n_threads, ...
+   as the range of positions [head, tail) */
+struct __pool_queue {
+    pthread_mutex_t lock;     /* Lock protecting head and tail */
+    uint32_t head;            /* Position of the oldest task */
+    uint32_t tail;            /* Position following the newest task */
+};
+
+/* The opaque type of the queue of a worker */
+typedef struct __pool_queue pool_queue;
+
+/* Worker thread */
+struct __pool_worker {
+    pool* p;                  /* Pool owning the worker */
+    uint32_t id;              /* Index of the worker */
+    uint32_t node;            /* NUMA node of the worker */
+    uint8_t pinned;           /* Flag indicating cpus holds the affinity */
+    cpu_set_t cpus;           /* Cpus of the node of the worker */
+    pthread_t thread;         /* Thread running the worker */
+};
+
+/* The opaque type of a worker */
+typedef struct __pool_worker pool_worker;
+
+/* Struct of pool */
+struct __pool {
+    uint32_t n_threads;       /* Number of workers */
+    uint32_t n_started;       /* Number of workers actually running */
+    uint32_t n_tasks;         /* Number of tasks */
+    uint32_t window;          /* Maximum distance from the retired tasks */
+    uint32_t retired;         /* Tasks below this one have been consumed */
+    uint8_t aborted;          /* Set when a task fails */
+    int error;                /* First error returned by a task */
+    pool_task fn;             /* Function executing the tasks */
+    void* ctx;                /* Context of the tasks */
+    pthread_mutex_t lock;     /* Lock protecting the state of the tasks */
+    pthread_cond_t cond;      /* Signaled on completion and retirement */
+    uint8_t* state;           /* State of every task */
+    int* result;              /* Value returned by every task */
+    pool_queue* queue;        /* Queues of the workers */
+    pool_worker* worker;      /* Workers */
+};
+
+uint32_t pool_cpus() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : n;
+}
+
+/* Read the cpus of a NUMA node (a list like "0-3,8-11")
+   Return:  0 on success, -1 if the node does not exist or has no cpus
+ */
+static int pool_node_cpus(uint32_t node, cpu_set_t* cpus) {
+    char name[64];
+    FILE* f;
+    unsigned a, b;
+    int c;
+
+    snprintf(name, sizeof(name), NODE_PATH "/node%u/cpulist", node);
+    f = fopen(name, "r");
+    if (f == NULL)
+        return -1;
+
+    CPU_ZERO(cpus);
+    while (fscanf(f, "%u", &a) == 1) {
+        b = a;
+        c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%u", &b) != 1)
+                break;
+            c = fgetc(f);
+        }
+        for (; a <= b && a < CPU_SETSIZE; ++a)
+            CPU_SET(a, cpus);
+        if (c != ',')
+            break;
+    }
+    fclose(f);
+    return (CPU_COUNT(cpus) > 0) ? 0 : -1;
+}
+
+/* Collect the NUMA nodes having cpus (memory-only nodes are skipped, as
+   workers could not run there)
+   Return:  the number of nodes stored into ids
+ */
+static uint32_t pool_topology(uint32_t* ids) {
+    cpu_set_t cpus;
+    uint32_t i;
+    uint32_t n = 0;
+
+    for (i = 0; i < NODE_MAX; ++i) {
+        if (pool_node_cpus(i, &cpus) == 0)
+            ids[n++] = i;
+    }
+    return n;
+}
+
+/* Try to take the oldest task of a queue
+   Return:  one of TAKE_OK, TAKE_EMPTY, TAKE_BLOCKED
+ */
+static int pool_take(pool* p, uint32_t q, uint32_t* task) {
+    pool_queue* pq = &p->queue[q];
+    uint32_t t;
+    uint32_t limit;
+    int ret = TAKE_EMPTY;
+
+    pthread_mutex_lock(&pq->lock);
+    if (pq->head < pq->tail) {
+        t = q + pq->head * p->n_threads;
+        /* retired is read without the pool lock: a stale value only
+           makes the worker go to sleep and check again */
+        limit = __atomic_load_n(&p->retired, __ATOMIC_ACQUIRE) + p->window;
+        if (p->window == 0 || t < limit) {
+            ++(pq->head);
+            *task = t;
+            ret = TAKE_OK;
+        } else {
+            ret = TAKE_BLOCKED;
+        }
+    }
+    pthread_mutex_unlock(&pq->lock);
+    return ret;
+}
+
+/* Take a task from the own queue or steal the oldest task of another
+   worker, which is also the one the consumer is going to need first
+   Return:  one of TAKE_OK, TAKE_EMPTY, TAKE_BLOCKED
+ */
+static int pool_next(pool* p, uint32_t id, uint32_t* task) {
+    uint32_t i;
+    uint32_t q;
+    uint32_t pass;
+    int ret;
+    int blocked = 0;
+
+    /* Victims on the same NUMA node are tried first */
+    for (pass = 0; pass < 2; ++pass) {
+        for (i = 0; i < p->n_threads; ++i) {
+            q = (id + i) % p->n_threads;
+            if ((p->worker[q].node == p->worker[id].node) != (pass == 0))
+                continue;
+            ret = pool_take(p, q, task);
+            if (ret == TAKE_OK)
+                return TAKE_OK;
+            if (ret == TAKE_BLOCKED)
+                blocked = 1;
+        }
+    }
+    return blocked ? TAKE_BLOCKED : TAKE_EMPTY;
+}
+
+static void* pool_run(void* arg) {
+    pool_worker* w = (pool_worker*) arg;
+    pool* p = w->p;
+    uint32_t task;
+    uint32_t retired;
+    int ret;
+
+    /* Pinning happens before any task, so that the buffers the tasks
+       allocate are first touched (and placed) on the node of the worker */
+    if (w->pinned)
+        sched_setaffinity(0, sizeof(cpu_set_t), &w->cpus);
+
+    for (;;) {
+        if (__atomic_load_n(&p->aborted, __ATOMIC_RELAXED))
+            break;
+
+        retired = __atomic_load_n(&p->retired, __ATOMIC_ACQUIRE);
+        ret = pool_next(p, w->id, &task);
+        if (ret == TAKE_EMPTY)
+            break;
+
+        if (ret == TAKE_BLOCKED) {
+            /* Sleep until the consumer retires some task */
+            pthread_mutex_lock(&p->lock);
+            while (p->retired == retired && !p->aborted)
+                pthread_cond_wait(&p->cond, &p->lock);
+            pthread_mutex_unlock(&p->lock);
+            continue;
+        }
+
+        ret = p->fn(p->ctx, w->id, task);
+
+        pthread_mutex_lock(&p->lock);
+        p->state[task] = TASK_DONE;
+        p->result[task] = ret;
+        if (ret != 0 && !p->aborted) {
+            p->aborted = 1;
+            p->error = ret;
+        }
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return NULL;
+}
+
+pool* pool_start(uint32_t n_threads, uint32_t n_tasks, pool_task fn,
+                 void* ctx, uint32_t window, uint8_t flags) {
+    pool* p;
+    uint32_t ids[NODE_MAX];
+    uint32_t n_nodes = 0;
+    uint32_t i;
+
+    n_threads = (n_threads == 0) ? 1 : n_threads;
+
+    p = calloc(1, sizeof(pool));
+    if (p == NULL)
+        return NULL;
+
+    p->n_threads = n_threads;
+    p->n_tasks = n_tasks;
+    p->window = window;
+    p->fn = fn;
+    p->ctx = ctx;
+    p->state = calloc(n_tasks + 1, sizeof(uint8_t));
+    p->result = calloc(n_tasks + 1, sizeof(int));
+    p->queue = calloc(n_threads, sizeof(pool_queue));
+    p->worker = calloc(n_threads, sizeof(pool_worker));
+    if (p->state == NULL || p->result == NULL || p->queue == NULL ||
+            p->worker == NULL) {
+        free(p->state);
+        free(p->result);
+        free(p->queue);
+        free(p->worker);
+        free(p);
+        return NULL;
+    }
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+
+    /* Round-robin deal of the tasks */
+    for (i = 0; i < n_threads; ++i) {
+        pthread_mutex_init(&p->queue[i].lock, NULL);
+        p->queue[i].head = 0;
+        p->queue[i].tail = (n_tasks + n_threads - 1 - i) / n_threads;
+    }
+
+    if (flags & POOL_NUMA)
+        n_nodes = pool_topology(ids);
+
+    for (i = 0; i < n_threads; ++i) {
+        p->worker[i].p = p;
+        p->worker[i].id = i;
+        /* Workers are interleaved so that every node gets its share */
+        p->worker[i].node = (n_nodes > 0) ? ids[i % n_nodes] : 0;
+        if (n_nodes > 1)
+            p->worker[i].pinned = (pool_node_cpus(p->worker[i].node,
+                                                  &p->worker[i].cpus) == 0);
+    }
+
+    for (i = 0; i < n_threads; ++i) {
+        if (pthread_create(&p->worker[i].thread, NULL, pool_run,
+                           &p->worker[i]) != 0)
+            break;
+        ++(p->n_started);
+    }
+
+    /* The tasks are stolen by the running workers anyway */
+    if (p->n_started == 0) {
+        pool_finish(p);
+        return NULL;
+    }
+    return p;
+}
+
+int pool_wait(pool* p, uint32_t task) {
+    int ret;
+
+    pthread_mutex_lock(&p->lock);
+    while (p->state[task] != TASK_DONE && !p->aborted)
+        pthread_cond_wait(&p->cond, &p->lock);
+    ret = (p->state[task] == TASK_DONE) ? p->result[task] : -1;
+    pthread_mutex_unlock(&p->lock);
+    return ret;
+}
+
+void pool_retire(pool* p, uint32_t task) {
+    pthread_mutex_lock(&p->lock);
+    if (task + 1 > p->retired)
+        __atomic_store_n(&p->retired, task + 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pool_abort(pool* p) {
+    pthread_mutex_lock(&p->lock);
+    p->aborted = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+int pool_finish(pool* p) {
+    uint32_t i;
+    int ret;
+
+    /* Nobody is going to retire tasks anymore */
+    pool_retire(p, p->n_tasks);
+
+    for (i = 0; i < p->n_started; ++i)
+        pthread_join(p->worker[i].thread, NULL);
+
+    ret = p->error;
+    for (i = 0; i < p->n_threads; ++i)
+        pthread_mutex_destroy(&p->queue[i].lock);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+    free(p->state);
+    free(p->result);
+    free(p->queue);
+    free(p->worker);
+    free(p);
+    return ret;
+}
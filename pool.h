@@ -0,0 +1,69 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __POOL_H
+#define __POOL_H
+
+#include <stdint.h>
+
+/* Task executed by the workers
+   ctx:     context given to pool_start()
+   worker:  index of the worker executing the task
+   task:    index of the task
+   Return:  0 on success, an error code otherwise
+ */
+typedef int (*pool_task)(void* ctx, uint32_t worker, uint32_t task);
+
+/* Flags of the pool */
+#define POOL_NUMA        1
+
+/* The opaque type representing a pool of worker threads */
+typedef struct __pool pool;
+
+/* Starts a pool executing the tasks [0, n_tasks) with n_threads workers.
+   Tasks are dealt round-robin to per-worker queues and idle workers steal
+   from the others. When window is not 0 a task is started only if it is
+   less than window tasks ahead of the oldest task not yet retired.
+   With POOL_NUMA the workers are spread over the NUMA nodes and pinned to
+   the cpus of their node, and they steal from workers of their own node
+   first: memory first touched by a task is then local to its worker.
+ */
+pool* pool_start(uint32_t n_threads, uint32_t n_tasks, pool_task fn,
+                 void* ctx, uint32_t window, uint8_t flags);
+
+/* Waits for the completion of a task
+   Return:  the value returned by the task, -1 if the pool has been aborted
+ */
+int pool_wait(pool* p, uint32_t task);
+
+/* Marks every task up to the given one as consumed */
+void pool_retire(pool* p, uint32_t task);
+
+/* Stops the workers as soon as they complete their current task */
+void pool_abort(pool* p);
+
+/* Waits for the workers and releases the pool
+   Return:  0 if every task succeeded, the first error code otherwise
+ */
+int pool_finish(pool* p);
+
+/* Return the number of processors available */
+uint32_t pool_cpus();
+
+#endif /* __POOL_H */
@@ -0,0 +1,147 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "ring.h"
+
+/* Number of polls before a waiter goes to sleep */
+#define RING_SPIN 1024
+
+/* Struct of ring: head and tail are only written by one side each, the
+   mutex is taken just to sleep when the ring is empty (or full) */
+struct __ring {
+    _Atomic uint32_t head;    /* Next slot to pop (written by the consumer) */
+    _Atomic uint32_t tail;    /* Next slot to push (written by the producer) */
+    _Atomic uint8_t aborted;  /* Abort flag */
+    _Atomic uint8_t sleeping; /* Flag indicating a waiter is sleeping */
+    uint32_t mask;            /* Number of slots - 1 */
+    pthread_mutex_t lock;     /* Lock protecting the sleep */
+    pthread_cond_t cond;      /* Condition used to sleep */
+    void* slot[0];            /* Slots (contiguous memory area) */
+};
+
+ring* ring_new(uint32_t size) {
+    ring* r;
+    uint32_t n = 1;
+
+    while (n < size)
+        n <<= 1;
+
+    r = calloc(1, sizeof(ring) + n * sizeof(void*));
+    if (r == NULL)
+        return NULL;
+
+    r->mask = n - 1;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    /* head, tail and flags are initialized by calloc */
+    return r;
+}
+
+/* Return 1 if the side identified by push can proceed */
+static inline int ring_ready(ring* r, int push) {
+    uint32_t head = atomic_load(&r->head);
+    uint32_t tail = atomic_load(&r->tail);
+
+    if (push)
+        return tail - head <= r->mask;
+    return tail != head;
+}
+
+/* Wait until the given side can proceed
+   Return:
+     0   ready
+    -1   aborted
+ */
+static int ring_wait(ring* r, int push) {
+    uint32_t i;
+
+    for (i = 0; i < RING_SPIN; ++i) {
+        if (atomic_load_explicit(&r->aborted, memory_order_relaxed))
+            return -1;
+        if (ring_ready(r, push))
+            return 0;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        atomic_store(&r->sleeping, 1);
+        if (atomic_load(&r->aborted) || ring_ready(r, push))
+            break;
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return atomic_load(&r->aborted) ? -1 : 0;
+}
+
+/* Wake up the other side if it went to sleep */
+static inline void ring_wake(ring* r) {
+    if (atomic_load(&r->sleeping)) {
+        pthread_mutex_lock(&r->lock);
+        atomic_store(&r->sleeping, 0);
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+int ring_push(ring* r, void* item) {
+    uint32_t tail;
+
+    if (ring_wait(r, 1) == -1)
+        return -1;
+
+    tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    r->slot[tail & r->mask] = item;
+    atomic_store(&r->tail, tail + 1);
+    ring_wake(r);
+    return 0;
+}
+
+void* ring_pop(ring* r) {
+    uint32_t head;
+    void* item;
+
+    if (ring_wait(r, 0) == -1)
+        return NULL;
+
+    head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    item = r->slot[head & r->mask];
+    atomic_store(&r->head, head + 1);
+    ring_wake(r);
+    return item;
+}
+
+void ring_abort(ring* r) {
+    atomic_store(&r->aborted, 1);
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+void ring_destroy(ring* r) {
+    if (r != NULL) {
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->cond);
+        free(r);
+    }
+}
@@ -0,0 +1,49 @@
+/*
+* Basic implementation of LZ78 compression algorithm
+*
+* Copyright (C) 2010 evilaliv3 <giovanni.pellerano@evilaliv3.org>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RING_H
+#define __RING_H
+
+#include <stdint.h>
+
+/* The opaque type used for single-producer single-consumer ring buffers */
+typedef struct __ring ring;
+
+/* Creates a new ring able to hold size pointers (rounded to a power of 2) */
+ring* ring_new(uint32_t size);
+
+/* Appends an item waiting while the ring is full
+   Return:
+     0   success
+    -1   the ring has been aborted
+ */
+int ring_push(ring* r, void* item);
+
+/* Removes the oldest item waiting while the ring is empty
+   Return:  the item, NULL if the ring has been aborted
+ */
+void* ring_pop(ring* r);
+
+/* Wakes up the waiters and makes every following operation fail */
+void ring_abort(ring* r);
+
+/* Relases the resources allocated by the ring */
+void ring_destroy(ring* r);
+
+#endif /* __RING_H */
@@ -20,8 +20,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "wrapper.h"
+#include "filter.h"
 
 /* Structure representing the type of algorithm */
 struct __algorithm {
@@ -35,6 +41,7 @@ typedef struct __algorithm algorithm;
 /* Struct of available algorithms */
 const algorithm algo_list[] = {
     {"lz78", LZ78_ALGORITHM}, 
+    {"lz77", LZ77_ALGORITHM},
     {NULL,   UNKNOWN_ALGORITHM}
 };
 
@@ -42,12 +49,30 @@ const algorithm algo_list[] = {
 struct __wrapper {
     uint8_t type;      /* Algorithm used to compress or decompress data */
     uint8_t mode;      /* Flag indicating compress/decompress mode */
+    uint8_t pipelined; /* Flag enabling the multi-threaded pipeline */
+    uint8_t estimate;  /* Flag replacing compression with its estimate */
+    uint8_t follow;    /* Flag enabling the wait for appends to the input */
+    uint64_t first;    /* First record extracted (0 extracts the files) */
+    uint64_t last;     /* Last record extracted */
+    char* index;       /* Index of the checkpoints of the stream (or NULL) */
+    uint64_t interval; /* Interval between the checkpoints of the index */
+    uint8_t ranged;    /* Flag restricting decompression to a range */
+    uint64_t offset;   /* Offset of the range */
+    uint64_t length;   /* Length of the range */
+    char* pattern;     /* Pattern searched in the stream (or NULL) */
+    uint8_t info;      /* Flag replacing decompression with statistics */
+    uint8_t test;      /* Flag replacing decompression with its test */
+    uint32_t param;    /* Additional parameter of the algorithm */
+    archive* arc;      /* Archive (NULL if not in archive mode) */
     void* data;        /* Opaque structure representing the algorithm */
 };
 
 /* Global variable representing the current error stored */
 uint8_t wrapper_cur_err = WRAPPER_SUCCESS;
 
+/* Compressor following its input, ended by the termination signals */
+static lz78_instance* wrapper_followed = NULL;
+
 /* Associate an algorithm-dependent error to a wrapper-generic error */
 uint8_t wrapper_return(uint8_t code) {
     wrapper_cur_err = code;
@@ -67,6 +92,40 @@ uint8_t wrapper_return(uint8_t code) {
         case LZ78_ERROR_DICTIONARY:
         case LZ78_ERROR_INITIALIZATION:
         case LZ78_ERROR_MODE:
+        case LZ78_ERROR_PIPELINE:
+            return WRAPPER_ERROR_GENERIC;
+        case LZ77_SUCCESS:
+            return WRAPPER_SUCCESS;
+        case LZ77_ERROR_READ:
+            return WRAPPER_ERROR_READ;
+        case LZ77_ERROR_WRITE:
+            return WRAPPER_ERROR_WRITE;
+        case LZ77_ERROR_EAGAIN:
+            return WRAPPER_ERROR_EAGAIN;
+        case LZ77_ERROR_COMPRESS:
+            return WRAPPER_ERROR_COMPRESS;
+        case LZ77_ERROR_DECOMPRESS:
+            return WRAPPER_ERROR_DECOMPRESS;
+        case LZ77_ERROR_MEMORY:
+        case LZ77_ERROR_INITIALIZATION:
+        case LZ77_ERROR_MODE:
+            return WRAPPER_ERROR_GENERIC;
+        case ARCHIVE_SUCCESS:
+            return WRAPPER_SUCCESS;
+        case ARCHIVE_ERROR_READ:
+            return WRAPPER_ERROR_READ;
+        case ARCHIVE_ERROR_WRITE:
+            return WRAPPER_ERROR_WRITE;
+        case ARCHIVE_ERROR_COMPRESS:
+            return WRAPPER_ERROR_COMPRESS;
+        case ARCHIVE_ERROR_DECOMPRESS:
+        case ARCHIVE_ERROR_FORMAT:
+        case ARCHIVE_ERROR_CHECKSUM:
+            return WRAPPER_ERROR_DECOMPRESS;
+        case ARCHIVE_ERROR_MEMORY:
+        case ARCHIVE_ERROR_PATH:
+        case ARCHIVE_ERROR_THREAD:
+        case ARCHIVE_ERROR_OPTION:
             return WRAPPER_ERROR_GENERIC;
     }
     return code;
@@ -132,7 +191,8 @@ void wrapper_perror() {
             break;
 
         case LZ78_ERROR_MODE:
-            fprintf(stderr, "LZ78: wrong compression/decompression mode\n");
+            fprintf(stderr, "LZ78: wrong compression/decompression mode "
+                    "or stream alphabet\n");
             break;
 
         case LZ78_ERROR_READ:
@@ -155,6 +215,88 @@ void wrapper_perror() {
             fprintf(stderr, "LZ78: unable to decompress input data\n");
             break;
 
+        case LZ78_ERROR_PIPELINE:
+            fprintf(stderr, "LZ78: unable to start the pipeline\n");
+            break;
+
+        case LZ77_SUCCESS:
+            break;
+
+        case LZ77_ERROR_MEMORY:
+            fprintf(stderr, "LZ77: unable to allocate buffers\n");
+            break;
+
+        case LZ77_ERROR_INITIALIZATION:
+            fprintf(stderr, "LZ77: bad initialization\n");
+            break;
+
+        case LZ77_ERROR_MODE:
+            fprintf(stderr, "LZ77: wrong compression/decompression mode\n");
+            break;
+
+        case LZ77_ERROR_READ:
+            fprintf(stderr, "LZ77: unable to read input data\n");
+            break;
+
+        case LZ77_ERROR_WRITE:
+            fprintf(stderr, "LZ77: unable to write output data\n");
+            break;
+
+        case LZ77_ERROR_EAGAIN:
+            fprintf(stderr, "LZ77: I/O operation would block: retry...\n");
+            break;
+
+        case LZ77_ERROR_COMPRESS:
+            fprintf(stderr, "LZ77: unable to compress input data\n");
+            break;
+
+        case LZ77_ERROR_DECOMPRESS:
+            fprintf(stderr, "LZ77: unable to decompress input data\n");
+            break;
+
+        case ARCHIVE_SUCCESS:
+            break;
+
+        case ARCHIVE_ERROR_MEMORY:
+            fprintf(stderr, "Archive: unable to allocate buffers\n");
+            break;
+
+        case ARCHIVE_ERROR_READ:
+            fprintf(stderr, "Archive: unable to read input data\n");
+            break;
+
+        case ARCHIVE_ERROR_WRITE:
+            fprintf(stderr, "Archive: unable to write output data\n");
+            break;
+
+        case ARCHIVE_ERROR_COMPRESS:
+            fprintf(stderr, "Archive: unable to compress input data\n");
+            break;
+
+        case ARCHIVE_ERROR_DECOMPRESS:
+            fprintf(stderr, "Archive: unable to decompress input data\n");
+            break;
+
+        case ARCHIVE_ERROR_FORMAT:
+            fprintf(stderr, "Archive: corrupted or unsupported archive\n");
+            break;
+
+        case ARCHIVE_ERROR_PATH:
+            fprintf(stderr, "Archive: invalid path\n");
+            break;
+
+        case ARCHIVE_ERROR_THREAD:
+            fprintf(stderr, "Archive: unable to start the workers\n");
+            break;
+
+        case ARCHIVE_ERROR_OPTION:
+            fprintf(stderr, "Archive: option not supported in this mode\n");
+            break;
+
+        case ARCHIVE_ERROR_CHECKSUM:
+            fprintf(stderr, "Archive: checksum mismatch of a block\n");
+            break;
+
         default:
             fprintf(stderr, "Unhandled error code %d\n", wrapper_cur_err);
     }
@@ -167,12 +309,31 @@ wrapper* wrapper_new(uint8_t w_mode, uint8_t w_type, char* argv) {
 
     w->type = w_type;
     w->mode = w_mode;
+    w->pipelined = 0;
+    w->estimate = 0;
+    w->follow = 0;
+    w->first = 0;
+    w->last = 0;
+    w->index = NULL;
+    w->interval = 0;
+    w->ranged = 0;
+    w->offset = 0;
+    w->length = 0;
+    w->pattern = NULL;
+    w->info = 0;
+    w->test = 0;
+    w->param = byte_size(argv);
+    w->arc = NULL;
 
     switch (w->type) {
         case LZ78_ALGORITHM:
             w->data = lz78_new(w_mode, byte_size(argv));
             break;
 
+        case LZ77_ALGORITHM:
+            w->data = lz77_new(w_mode, byte_size(argv));
+            break;
+
         default:
             free(w);
             return NULL;
@@ -186,28 +347,271 @@ wrapper* wrapper_new(uint8_t w_mode, uint8_t w_type, char* argv) {
     }
 }
 
+/* Set the chain of filters of the archive from its description */
+static uint8_t wrapper_filter(wrapper* w, char* spec) {
+    filter chain[FILTER_CHAIN_MAX];
+    uint8_t ret;
+    int n, i;
+
+    n = filter_parse(spec, chain);
+    if (n == -1)
+        return wrapper_return(ARCHIVE_ERROR_OPTION);
+
+    for (i = 0; i < n; ++i) {
+        ret = archive_set(w->arc, ARCHIVE_OPTION_FILTER,
+                          (chain[i].kind << 8) | chain[i].stride);
+        if (ret != ARCHIVE_SUCCESS)
+            return wrapper_return(ret);
+    }
+    return WRAPPER_SUCCESS;
+}
+
+uint8_t wrapper_set(wrapper* w, uint8_t option, char* value) {
+    char* end;
+
+    switch (option) {
+        case WRAPPER_OPTION_PIPELINE:
+            if (w->type != LZ78_ALGORITHM)
+                return wrapper_return(WRAPPER_ERROR_ALGORITHM);
+            w->pipelined = 1;
+            break;
+
+        case WRAPPER_OPTION_ESTIMATE:
+            if (w->type != LZ78_ALGORITHM || w->mode != WRAPPER_MODE_COMPRESS)
+                return wrapper_return(WRAPPER_ERROR_ALGORITHM);
+            w->estimate = 1;
+            break;
+
+        case WRAPPER_OPTION_WIDE:
+            if (w->type != LZ78_ALGORITHM)
+                return wrapper_return(WRAPPER_ERROR_ALGORITHM);
+            /* The decompressor learns the alphabet from the stream */
+            if (w->mode == WRAPPER_MODE_DECOMPRESS)
+                break;
+            if (w->arc != NULL)
+                return wrapper_return(archive_set(w->arc,
+                                                  ARCHIVE_OPTION_ALPHABET,
+                                                  LZ78_ALPHABET_WIDE));
+            return wrapper_return(lz78_set(w->data, LZ78_OPTION_ALPHABET,
+                                           LZ78_ALPHABET_WIDE));
+
+        case WRAPPER_OPTION_FLUSH_MS:
+        case WRAPPER_OPTION_FLUSH_LINES:
+            if (w->type != LZ78_ALGORITHM)
+                return wrapper_return(WRAPPER_ERROR_ALGORITHM);
+            if (w->arc != NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            /* The decompressor honours every flush point of the stream */
+            if (w->mode == WRAPPER_MODE_DECOMPRESS)
+                break;
+            /* Flush points are emitted by the serial compressor only */
+            w->pipelined = 0;
+            return wrapper_return(lz78_set(w->data,
+                                           option == WRAPPER_OPTION_FLUSH_MS ?
+                                           LZ78_OPTION_FLUSH_MS :
+                                           LZ78_OPTION_FLUSH_LINES,
+                                           atoi(value)));
+
+        case WRAPPER_OPTION_FOLLOW:
+            if (w->type != LZ78_ALGORITHM ||
+                    w->mode != WRAPPER_MODE_COMPRESS)
+                return wrapper_return(WRAPPER_ERROR_ALGORITHM);
+            if (w->arc != NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            w->follow = 1;
+            w->pipelined = 0;
+            return wrapper_return(lz78_set(w->data, LZ78_OPTION_FOLLOW, 1));
+
+        case WRAPPER_OPTION_INDEX:
+        case WRAPPER_OPTION_INTERVAL:
+        case WRAPPER_OPTION_RANGE:
+            if (w->type != LZ78_ALGORITHM ||
+                    w->mode != WRAPPER_MODE_DECOMPRESS)
+                return wrapper_return(WRAPPER_ERROR_ALGORITHM);
+            if (w->arc != NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            if (option == WRAPPER_OPTION_INDEX) {
+                w->index = value;
+            } else if (option == WRAPPER_OPTION_INTERVAL) {
+                w->interval = byte_size(value);
+            } else {
+                /* offset:length, or offset up to the end */
+                w->offset = strtoull(value, &end, 10);
+                w->length = (*end == ':') ? strtoull(end + 1, &end, 10) :
+                            UINT64_MAX;
+                if (*end != '\0')
+                    return wrapper_return(WRAPPER_ERROR_GENERIC);
+                w->ranged = 1;
+            }
+            break;
+
+        case WRAPPER_OPTION_GREP:
+            if (w->type != LZ78_ALGORITHM ||
+                    w->mode != WRAPPER_MODE_DECOMPRESS)
+                return wrapper_return(WRAPPER_ERROR_ALGORITHM);
+            if (w->arc != NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            if (strlen(value) == 0 || strlen(value) > LZ78_GREP_MAX ||
+                    strchr(value, '\n') != NULL)
+                return wrapper_return(WRAPPER_ERROR_GENERIC);
+            w->pattern = value;
+            break;
+
+        case WRAPPER_OPTION_INFO:
+            if (w->type != LZ78_ALGORITHM ||
+                    w->mode != WRAPPER_MODE_DECOMPRESS)
+                return wrapper_return(WRAPPER_ERROR_ALGORITHM);
+            if (w->arc != NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            w->info = 1;
+            break;
+
+        case WRAPPER_OPTION_TEST:
+            /* Plain lz77 streams have nothing to verify but their decoding */
+            if (w->mode != WRAPPER_MODE_DECOMPRESS ||
+                    (w->type != LZ78_ALGORITHM && w->arc == NULL))
+                return wrapper_return(WRAPPER_ERROR_ALGORITHM);
+            w->test = 1;
+            break;
+
+        case WRAPPER_OPTION_ARCHIVE:
+            if (w->arc != NULL)
+                break;
+            w->arc = archive_new(w->mode == WRAPPER_MODE_COMPRESS ?
+                                 ARCHIVE_MODE_CREATE : ARCHIVE_MODE_EXTRACT,
+                                 w->type == LZ78_ALGORITHM ?
+                                 ARCHIVE_BLOCK_LZ78 : ARCHIVE_BLOCK_LZ77,
+                                 w->param);
+            if (w->arc == NULL)
+                return wrapper_return(ARCHIVE_ERROR_MEMORY);
+            break;
+
+        case WRAPPER_OPTION_THREADS:
+            if (w->arc == NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            return wrapper_return(archive_set(w->arc, ARCHIVE_OPTION_THREADS,
+                                              atoi(value)));
+
+        case WRAPPER_OPTION_BLOCK_SIZE:
+            if (w->arc == NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            return wrapper_return(archive_set(w->arc, ARCHIVE_OPTION_BLOCK_SIZE,
+                                              byte_size(value)));
+
+        case WRAPPER_OPTION_SOLID:
+            if (w->arc == NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            return wrapper_return(archive_set(w->arc, ARCHIVE_OPTION_SOLID, 1));
+
+        case WRAPPER_OPTION_NUMA:
+            if (w->arc == NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            return wrapper_return(archive_set(w->arc, ARCHIVE_OPTION_NUMA, 1));
+
+        case WRAPPER_OPTION_PRIME:
+            if (w->arc == NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            if (w->type != LZ78_ALGORITHM)
+                return wrapper_return(WRAPPER_ERROR_ALGORITHM);
+            return wrapper_return(archive_set(w->arc, ARCHIVE_OPTION_PRIME,
+                                              byte_size(value)));
+
+        case WRAPPER_OPTION_FILTER:
+            if (w->arc == NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            return wrapper_filter(w, value);
+
+        case WRAPPER_OPTION_NO_CHECKSUM:
+            if (w->arc == NULL || w->mode != WRAPPER_MODE_COMPRESS)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            return wrapper_return(archive_set(w->arc, ARCHIVE_OPTION_CHECKSUM,
+                                              0));
+
+        case WRAPPER_OPTION_BATCH:
+            if (w->arc == NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            return wrapper_return(archive_set(w->arc, ARCHIVE_OPTION_RECORDS,
+                                              atoi(value)));
+
+        case WRAPPER_OPTION_RECORDS:
+            if (w->arc == NULL || w->mode != WRAPPER_MODE_DECOMPRESS)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            /* A range A-B or a single record A */
+            w->first = strtoull(value, &end, 10);
+            w->last = (*end == '-') ? strtoull(end + 1, &end, 10) : w->first;
+            if (*end != '\0' || w->first == 0 || w->first > w->last)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            break;
+
+        case WRAPPER_OPTION_INPUT:
+            if (w->arc == NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            return wrapper_return(archive_add(w->arc, value));
+
+        case WRAPPER_OPTION_FILE_LIST:
+            if (w->arc == NULL)
+                return wrapper_return(ARCHIVE_ERROR_OPTION);
+            return wrapper_return(archive_add_list(w->arc, value));
+
+        default:
+            return wrapper_return(WRAPPER_ERROR_GENERIC);
+    }
+    return WRAPPER_SUCCESS;
+}
+
 void wrapper_destroy(wrapper* w) {
     if (w == NULL)
         return;
 
+    archive_destroy(w->arc);
+
     switch (w->type) {
         case LZ78_ALGORITHM:
             lz78_destroy(w->data);
             break;
 
+        case LZ77_ALGORITHM:
+            lz77_destroy(w->data);
+            break;
+
         default:
             return;
     }
     free(w);
 }
 
+/* End the followed input, so that the stream is completed */
+static void wrapper_stop(int sig) {
+    lz78_stop(wrapper_followed);
+}
+
+/* Complete the stream of a followed input on the termination signals */
+static void wrapper_follow(wrapper* w) {
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = wrapper_stop;
+    sigemptyset(&sa.sa_mask);
+    wrapper_followed = w->data;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+}
+
 uint8_t wrapper_compress(wrapper* w, char* input, char* output) {
     uint8_t ret;
     int fd_in;
     int fd_out;
 
+    /* Only a named file can be followed */
+    if (w->follow && input == NULL)
+        return wrapper_return(WRAPPER_ERROR_FILE_IN);
+    if (w->follow)
+        wrapper_follow(w);
+
     switch (w->type) {
         case LZ78_ALGORITHM:
+        case LZ77_ALGORITHM:
             if (input == NULL) {
                 fd_in = STDIN_FILENO;
             } else {
@@ -226,7 +630,12 @@ uint8_t wrapper_compress(wrapper* w, char* input, char* output) {
                 }
             }
 
-            ret = lz78_compress(w->data, fd_in, fd_out);
+            if (w->type == LZ78_ALGORITHM && w->pipelined)
+                ret = lz78_compress_pipelined(w->data, fd_in, fd_out);
+            else if (w->type == LZ78_ALGORITHM)
+                ret = lz78_compress(w->data, fd_in, fd_out);
+            else
+                ret = lz77_compress(w->data, fd_in, fd_out);
 
             close(fd_in);
             close(fd_out);
@@ -244,6 +653,7 @@ uint8_t wrapper_decompress(wrapper* w, char* input, char* output) {
 
     switch (w->type) {
         case LZ78_ALGORITHM:
+        case LZ77_ALGORITHM:
             if (input == NULL) {
                 fd_in = STDIN_FILENO;
             } else {
@@ -262,7 +672,12 @@ uint8_t wrapper_decompress(wrapper* w, char* input, char* output) {
                 }
              }
             
-            ret = lz78_decompress(w->data, fd_in, fd_out);
+            if (w->type == LZ78_ALGORITHM && w->pipelined)
+                ret = lz78_decompress_pipelined(w->data, fd_in, fd_out);
+            else if (w->type == LZ78_ALGORITHM)
+                ret = lz78_decompress(w->data, fd_in, fd_out);
+            else
+                ret = lz77_decompress(w->data, fd_in, fd_out);
 
             close(fd_in);
             close(fd_out);
@@ -273,8 +688,324 @@ uint8_t wrapper_decompress(wrapper* w, char* input, char* output) {
     }
 }
 
+uint8_t wrapper_archive(wrapper* w, char* input, char* output) {
+    uint8_t ret;
+    int fd, fd_out;
+
+    if (w->mode == WRAPPER_MODE_COMPRESS) {
+        if (input != NULL) {
+            ret = archive_add(w->arc, input);
+            if (ret != ARCHIVE_SUCCESS)
+                return wrapper_return(ret);
+        }
+
+        if (output == NULL) {
+            fd = STDOUT_FILENO;
+        } else {
+            fd = open(output, ACCESS_WRITE, 0644);
+            if (fd == -1)
+                return wrapper_return(WRAPPER_ERROR_FILE_OUT);
+        }
+
+        ret = archive_create(w->arc, fd);
+    } else {
+        if (input == NULL) {
+            fd = STDIN_FILENO;
+        } else {
+            fd = open(input, ACCESS_READ);
+            if (fd == -1)
+                return wrapper_return(WRAPPER_ERROR_FILE_IN);
+        }
+
+        if (w->test) {
+            ret = archive_test(w->arc, fd);
+        } else if (w->first == 0) {
+            ret = archive_extract(w->arc, fd, output);
+        } else if (output == NULL) {
+            ret = archive_records(w->arc, fd, w->first, w->last,
+                                  STDOUT_FILENO);
+        } else {
+            fd_out = open(output, ACCESS_WRITE, 0644);
+            if (fd_out == -1) {
+                close(fd);
+                return wrapper_return(WRAPPER_ERROR_FILE_OUT);
+            }
+            ret = archive_records(w->arc, fd, w->first, w->last, fd_out);
+            close(fd_out);
+        }
+    }
+
+    close(fd);
+    return wrapper_return(ret);
+}
+
+/* Read the whole input into memory (mapping it when it is a file)
+   Return:  0 on success, -1 on failure
+ */
+static int wrapper_load(int fd, char** buf, uint64_t* size, uint8_t* mapped) {
+    struct stat st;
+    struct pollfd pfd;
+    uint64_t cap = B_SIZE_DEFAULT;
+    ssize_t r;
+    char* tmp;
+
+    *mapped = 0;
+    *size = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (*buf != MAP_FAILED) {
+            *size = st.st_size;
+            *mapped = 1;
+            return 0;
+        }
+    }
+
+    *buf = malloc(cap);
+    if (*buf == NULL)
+        return -1;
+    for (;;) {
+        if (*size == cap) {
+            tmp = realloc(*buf, cap * 2);
+            if (tmp == NULL)
+                return -1;
+            *buf = tmp;
+            cap *= 2;
+        }
+        r = read(fd, *buf + *size, cap - *size);
+        if (r == 0)
+            return 0;
+        if (r > 0) {
+            *size += r;
+        } else if (errno == EAGAIN) {
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            poll(&pfd, 1, -1);
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+uint8_t wrapper_estimate(wrapper* w, char* input, char* output) {
+    char* buf = NULL;
+    uint64_t size;
+    uint8_t mapped;
+    double ratio;
+    double speed;
+    uint8_t ret;
+    int fd_in;
+    int fd_out;
+
+    if (input == NULL) {
+        fd_in = STDIN_FILENO;
+    } else {
+        fd_in = open(input, ACCESS_READ);
+        if (fd_in == -1)
+            return wrapper_return(WRAPPER_ERROR_FILE_IN);
+    }
+
+    if (wrapper_load(fd_in, &buf, &size, &mapped) == -1) {
+        free(buf);
+        close(fd_in);
+        return wrapper_return(LZ78_ERROR_READ);
+    }
+    close(fd_in);
+
+    ret = lz78_estimate(w->data, buf, size, &ratio, &speed);
+    if (mapped)
+        munmap(buf, size);
+    else
+        free(buf);
+    if (ret != LZ78_SUCCESS)
+        return wrapper_return(ret);
+
+    if (output == NULL) {
+        fd_out = STDOUT_FILENO;
+    } else {
+        fd_out = open(output, ACCESS_WRITE, 0644);
+        if (fd_out == -1)
+            return wrapper_return(WRAPPER_ERROR_FILE_OUT);
+    }
+
+    ret = LZ78_SUCCESS;
+    if (dprintf(fd_out, "ratio %.3f\nspeed %.1f MB/s\n", ratio,
+                speed / 1048576) < 0)
+        ret = LZ78_ERROR_WRITE;
+    close(fd_out);
+    return wrapper_return(ret);
+}
+
+/* Write the index of the checkpoints of the input stream, or decompress
+   a range of the input stream using its index (if any) */
+uint8_t wrapper_checkpoint(wrapper* w, char* input, char* output) {
+    uint8_t ret;
+    int fd_in;
+    int fd_index = -1;
+    int fd_out;
+
+    if (input == NULL) {
+        fd_in = STDIN_FILENO;
+    } else {
+        fd_in = open(input, ACCESS_READ);
+        if (fd_in == -1)
+            return wrapper_return(WRAPPER_ERROR_FILE_IN);
+    }
+
+    if (!w->ranged) {
+        fd_out = open(w->index, ACCESS_WRITE, 0644);
+        if (fd_out == -1) {
+            close(fd_in);
+            return wrapper_return(WRAPPER_ERROR_FILE_OUT);
+        }
+        ret = lz78_index(w->data, fd_in, fd_out, w->interval);
+        close(fd_out);
+        close(fd_in);
+        return wrapper_return(ret);
+    }
+
+    if (w->index != NULL) {
+        fd_index = open(w->index, ACCESS_READ);
+        if (fd_index == -1) {
+            close(fd_in);
+            return wrapper_return(WRAPPER_ERROR_FILE_IN);
+        }
+    }
+
+    if (output == NULL) {
+        fd_out = STDOUT_FILENO;
+    } else {
+        fd_out = open(output, ACCESS_WRITE, 0644);
+        if (fd_out == -1) {
+            if (fd_index != -1)
+                close(fd_index);
+            close(fd_in);
+            return wrapper_return(WRAPPER_ERROR_FILE_OUT);
+        }
+    }
+
+    ret = lz78_decompress_range(w->data, fd_in, fd_index, w->offset,
+                                w->length, fd_out);
+    close(fd_out);
+    if (fd_index != -1)
+        close(fd_index);
+    close(fd_in);
+    return wrapper_return(ret);
+}
+
+/* Write the lines of the input stream containing the pattern */
+uint8_t wrapper_grep(wrapper* w, char* input, char* output) {
+    uint8_t ret;
+    int fd_in;
+    int fd_out;
+
+    if (input == NULL) {
+        fd_in = STDIN_FILENO;
+    } else {
+        fd_in = open(input, ACCESS_READ);
+        if (fd_in == -1)
+            return wrapper_return(WRAPPER_ERROR_FILE_IN);
+    }
+
+    if (output == NULL) {
+        fd_out = STDOUT_FILENO;
+    } else {
+        fd_out = open(output, ACCESS_WRITE, 0644);
+        if (fd_out == -1) {
+            close(fd_in);
+            return wrapper_return(WRAPPER_ERROR_FILE_OUT);
+        }
+    }
+
+    ret = lz78_grep(w->data, fd_in, w->pattern, fd_out);
+    close(fd_out);
+    close(fd_in);
+    return wrapper_return(ret);
+}
+
+/* Write the size, the newlines and the byte histogram (values occurring
+   only) of the data of the input stream */
+uint8_t wrapper_info(wrapper* w, char* input, char* output) {
+    lz78_stats stats;
+    uint8_t ret;
+    int fd_in;
+    int fd_out;
+    int i;
+
+    if (input == NULL) {
+        fd_in = STDIN_FILENO;
+    } else {
+        fd_in = open(input, ACCESS_READ);
+        if (fd_in == -1)
+            return wrapper_return(WRAPPER_ERROR_FILE_IN);
+    }
+
+    ret = lz78_info(w->data, fd_in, &stats);
+    close(fd_in);
+    if (ret != LZ78_SUCCESS)
+        return wrapper_return(ret);
+
+    if (output == NULL) {
+        fd_out = STDOUT_FILENO;
+    } else {
+        fd_out = open(output, ACCESS_WRITE, 0644);
+        if (fd_out == -1)
+            return wrapper_return(WRAPPER_ERROR_FILE_OUT);
+    }
+
+    if (dprintf(fd_out, "size %llu\nlines %llu\n",
+                (unsigned long long) stats.size,
+                (unsigned long long) stats.lines) < 0)
+        ret = LZ78_ERROR_WRITE;
+    for (i = 0; i < 256 && ret == LZ78_SUCCESS; ++i) {
+        if (stats.histogram[i] > 0 &&
+                dprintf(fd_out, "byte 0x%02x %llu\n", i,
+                        (unsigned long long) stats.histogram[i]) < 0)
+            ret = LZ78_ERROR_WRITE;
+    }
+    close(fd_out);
+    return wrapper_return(ret);
+}
+
+/* Decode the input stream validating every code, without writing */
+uint8_t wrapper_test(wrapper* w, char* input) {
+    lz78_stats stats;
+    uint8_t ret;
+    int fd_in;
+
+    if (input == NULL) {
+        fd_in = STDIN_FILENO;
+    } else {
+        fd_in = open(input, ACCESS_READ);
+        if (fd_in == -1)
+            return wrapper_return(WRAPPER_ERROR_FILE_IN);
+    }
+
+    ret = lz78_info(w->data, fd_in, &stats);
+    close(fd_in);
+    return wrapper_return(ret);
+}
+
 uint8_t wrapper_exec(wrapper* w, char* input, char* output) {
     uint8_t ret;
+
+    if (w->arc != NULL)
+        return wrapper_archive(w, input, output);
+
+    if (w->index != NULL || w->ranged)
+        return wrapper_checkpoint(w, input, output);
+
+    if (w->pattern != NULL)
+        return wrapper_grep(w, input, output);
+
+    if (w->info)
+        return wrapper_info(w, input, output);
+
+    if (w->test)
+        return wrapper_test(w, input);
+
+    if (w->estimate)
+        return wrapper_estimate(w, input, output);
+
     if (w->mode == WRAPPER_MODE_COMPRESS) {
         for (;;) {
             ret = wrapper_compress(w, input, output);
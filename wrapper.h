@@ -21,15 +21,44 @@
 #define __WRAPPER_H
 
 #include "lz78.h"
+#include "lz77.h"
+#include "archive.h"
 
 /* List of included compression algorithms */
 #define UNKNOWN_ALGORITHM         0
 #define LZ78_ALGORITHM            1
+#define LZ77_ALGORITHM            2
 
 /* Modes of compression */
 #define WRAPPER_MODE_COMPRESS     0
 #define WRAPPER_MODE_DECOMPRESS   1
 
+/* List of wrapper options */
+#define WRAPPER_OPTION_PIPELINE   1
+#define WRAPPER_OPTION_ARCHIVE    2
+#define WRAPPER_OPTION_THREADS    3
+#define WRAPPER_OPTION_BLOCK_SIZE 4
+#define WRAPPER_OPTION_INPUT      5
+#define WRAPPER_OPTION_FILE_LIST  6
+#define WRAPPER_OPTION_SOLID      7
+#define WRAPPER_OPTION_PRIME      8
+#define WRAPPER_OPTION_NUMA       9
+#define WRAPPER_OPTION_ESTIMATE   10
+#define WRAPPER_OPTION_FILTER     11
+#define WRAPPER_OPTION_WIDE       12
+#define WRAPPER_OPTION_FLUSH_MS   13
+#define WRAPPER_OPTION_FLUSH_LINES 14
+#define WRAPPER_OPTION_FOLLOW     15
+#define WRAPPER_OPTION_BATCH      16
+#define WRAPPER_OPTION_RECORDS    17
+#define WRAPPER_OPTION_INDEX      18
+#define WRAPPER_OPTION_INTERVAL   19
+#define WRAPPER_OPTION_RANGE      20
+#define WRAPPER_OPTION_GREP       21
+#define WRAPPER_OPTION_INFO       22
+#define WRAPPER_OPTION_TEST       23
+#define WRAPPER_OPTION_NO_CHECKSUM 24
+
 /* List of managed wrapper-level errors */
 #define WRAPPER_SUCCESS           20
 #define WRAPPER_ERROR_ALGORITHM   21
@@ -55,7 +84,30 @@ wrapper* wrapper_new(uint8_t w_mode, uint8_t w_type, char* w_argv);
 /* Deallocates a wrapper */
 void wrapper_destroy(wrapper* w);
 
+/* Set an option of the wrapper:
+   option   one of the wrapper options
+   value    value of the option (NULL for flags)
+   Return:
+     WRAPPER_SUCCESS          on success
+     WRAPPER_ERROR_ALGORITHM  option not supported by the algorithm
+     WRAPPER_ERROR_GENERIC    option requiring the archive mode or
+                              archive-dependent error
+ */
+uint8_t wrapper_set(wrapper* w, uint8_t option, char* value);
+
 /* Execute the function associated with the wrapper (compress/decompress)
+   In archive mode the input is added to the archive (compress) or is the
+   archive to extract, and the output is the archive (compress) or the
+   destination directory (decompress), or the file receiving the selected
+   records of a record archive; in test mode the input (an lz78 stream or
+   an archive) is decoded and verified without writing anything; with an
+   index of checkpoints and no range an lz78 stream is decoded to write the
+   index, with a range only its data are written to the output; with a
+   pattern the lines of an lz78 stream containing it are written to the
+   output; in info mode the size, the newlines and the byte histogram of the
+   data of an lz78 stream are written to the output; in estimate mode the
+   predicted ratio and throughput of the compression of the input are
+   written to the output
    Return:
      WRAPPER_SUCCESS          on success
      WRAPPER_ERROR_FILE_IN    unable to open input file